@@ -6,6 +6,7 @@
 #include <chrono>
 #include <atomic>
 #include <filesystem>
+#include <thread>
 
 using namespace vfs;
 
@@ -216,6 +217,60 @@ void testCacheEfficiency() {
     std::filesystem::remove(test_db);
 }
 
+void testCacheContention() {
+    std::cout << "\n=== Result Cache Contention ===" << std::endl;
+    
+    const size_t num_keys = 4096;
+    const size_t ops_per_thread = 200000;
+    
+    std::vector<matcher::ResultCache::Key> keys;
+    for (size_t i = 0; i < num_keys; ++i) {
+        keys.push_back(i * 0x9E3779B97F4A7C15ull);
+    }
+    
+    std::cout << std::endl;
+    std::cout << std::setw(10) << "Shards"
+              << std::setw(10) << "Threads"
+              << std::setw(20) << "Lookups/second" << std::endl;
+    std::cout << std::string(40, '-') << std::endl;
+    
+    for (size_t shards : {size_t(1), size_t(16)}) {
+        for (size_t threads : {size_t(1), size_t(2), size_t(4), size_t(8)}) {
+            matcher::ResultCache::Config cache_config;
+            cache_config.capacity = num_keys;
+            cache_config.num_shards = shards;
+            
+            matcher::ResultCache cache(cache_config);
+            auto empty = std::make_shared<const matcher::ResultCache::ResultSet>();
+            for (const auto& key : keys) {
+                cache.insert(key, empty);
+            }
+            
+            auto start = std::chrono::steady_clock::now();
+            
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&cache, &keys, t]() {
+                    for (size_t i = 0; i < ops_per_thread; ++i) {
+                        cache.lookup(keys[(i * 7919 + t * 104729) % keys.size()]);
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            
+            auto end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - start).count();
+            
+            std::cout << std::setw(10) << cache.numShards()
+                      << std::setw(10) << threads
+                      << std::setw(20) << std::fixed << std::setprecision(0)
+                      << (threads * ops_per_thread / seconds) << std::endl;
+        }
+    }
+}
+
 int main() {
     std::cout << R"(
 ╔════════════════════════════════════════════════════════════╗
@@ -232,6 +287,7 @@ int main() {
         testThreadPoolPerformance();
         testConcurrentMatching();
         testCacheEfficiency();
+        testCacheContention();
         
         std::cout << "\n=== Benchmark Complete ===" << std::endl;
         
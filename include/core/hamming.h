@@ -0,0 +1,37 @@
+#ifndef HAMMING_H
+#define HAMMING_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace vfs {
+namespace core {
+
+/**
+ * @brief Popcount kernels for comparing sub-fingerprint arrays
+ *
+ * Inputs are arrays of 32-bit sub-fingerprints in native byte order.
+ * They need not be aligned, so SQLite BLOB pointers can be passed
+ * directly without copying.
+ */
+
+/**
+ * @brief Number of differing bits between two arrays of num_words words
+ */
+uint64_t hammingDistance(const void* a, const void* b, size_t num_words);
+
+/**
+ * @brief Number of equal bits with query[i] aligned to stored[i + offset]
+ *
+ * Only the overlapping words are compared; words of the query that fall
+ * outside the stored fingerprint contribute no matching bits.
+ */
+uint64_t alignedMatchingBits(
+    const void* query, size_t query_words,
+    const void* stored, size_t stored_words,
+    int64_t offset);
+
+} // namespace core
+} // namespace vfs
+
+#endif // HAMMING_H
@@ -2,12 +2,20 @@
 #define DATABASE_MANAGER_H
 
 #include "core/fingerprint_generator.h"
+#include "index/segmented_index.h"
+#include "index/index_builder.h"
+#include "index/tiered_store.h"
+#include "index/bloom_filter.h"
+#include "utils/thread_pool.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <sqlite3.h>
 #include <optional>
+#include <unordered_map>
+#include <chrono>
 
 namespace vfs {
 namespace database {
@@ -29,13 +37,37 @@ public:
         int64_t created_at;
     };
 
+    // Point in time after which a query stops early; max() means none
+    using Deadline = std::chrono::steady_clock::time_point;
+
     struct MatchResult {
         ContentMetadata metadata;
         double similarity_score;
         uint32_t matched_segments;
+        bool scored = true;   // False: deadline hit first; score is the voted fraction
+    };
+
+    // Votes per stored offset of one content, and per content row id
+    using OffsetVotes = std::unordered_map<int32_t, uint32_t>;
+    using VoteTable = std::unordered_map<uint32_t, OffsetVotes>;
+
+    struct Config {
+        size_t max_candidates;           // Candidates re-ranked per query
+        size_t max_postings_per_hash;    // Cap on postings read per query hash (index path)
+        size_t scoring_threads;          // Threads re-ranking candidates
+        size_t min_parallel_candidates;  // Below this, re-rank on the caller
+        double hash_filter_fpr;          // Stored-hash filter FP rate, SQL path (0 = none)
+
+        // Default constructor with default values
+        Config()
+            : max_candidates(32)
+            , max_postings_per_hash(1024)
+            , scoring_threads(4)
+            , min_parallel_candidates(16)
+            , hash_filter_fpr(0.01) {}
     };
 
-    explicit DatabaseManager(const std::string& db_path);
+    explicit DatabaseManager(const std::string& db_path, const Config& config = Config());
     ~DatabaseManager();
 
     // Prevent copying
@@ -61,21 +93,145 @@ public:
 
     /**
      * @brief Find matching content for a fingerprint
+     *
+     * Candidates are voted by (content, time offset). The best-voted ones
+     * are re-ranked by the fraction of query bits that agree with the
+     * stored fingerprint at the winning offset.
+     *
+     * Past the deadline, hash lookups and re-ranking stop where they are.
+     * Candidates are re-ranked most-voted first, and the most-voted one is
+     * always scored. Candidates left unscored are still returned, after
+     * the scored ones, with the fraction of query hashes that voted for
+     * them as their score and scored = false.
+     *
      * @param fingerprint Query fingerprint
      * @param min_similarity Minimum similarity threshold (0.0 to 1.0)
      * @param max_results Maximum number of results to return
+     * @param deadline Time budget of the query
+     * @param partial Set to whether the deadline cut the query short
      * @return Vector of matching results sorted by similarity
      */
     std::vector<MatchResult> findMatches(
         const core::FingerprintGenerator::Fingerprint& fingerprint,
         double min_similarity = 0.7,
-        size_t max_results = 10);
+        size_t max_results = 10,
+        Deadline deadline = Deadline::max(),
+        bool* partial = nullptr);
+
+    /**
+     * @brief Whether candidate votes come from an attached posting index
+     *        or tiered store
+     */
+    bool hasIndex() const {
+        return index_ptr_.load(std::memory_order_acquire) != nullptr ||
+               tiered_store_ptr_.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /**
+     * @brief Add the index votes of hashes[begin, end) to a vote table
+     *
+     * Thread-safe and lock-free with respect to the database, so ranges
+     * of one long query can be voted on several threads and merged. A
+     * no-op without an attached index.
+     *
+     * @return false if the deadline stopped it before end
+     */
+    bool voteRange(
+        const std::vector<uint32_t>& hashes,
+        size_t begin,
+        size_t end,
+        VoteTable& votes,
+        Deadline deadline = Deadline::max()) const;
+
+    /**
+     * @brief Index postings of one hash, as voting uses them
+     * @return Postings to vote with at the front of out, at most
+     *         max_postings_per_hash (0 without an attached index)
+     */
+    size_t lookupPostings(uint32_t hash, std::vector<index::Posting>& out) const;
+
+    /**
+     * @brief Add every vote of one table to another
+     */
+    static void mergeVotes(VoteTable& into, const VoteTable& from);
+
+    /**
+     * @brief Re-rank the candidates of a vote table, as findMatches does
+     */
+    std::vector<MatchResult> rankVotes(
+        const core::FingerprintGenerator::Fingerprint& fingerprint,
+        const VoteTable& votes,
+        double min_similarity = 0.7,
+        size_t max_results = 10,
+        Deadline deadline = Deadline::max(),
+        bool* partial = nullptr);
+
+    /**
+     * @brief Serve candidate lookups from an in-memory posting index
+     *
+     * Existing postings are loaded into the index, and subsequent
+     * storeFingerprint calls feed it as well. Lookups then no longer
+     * go through SQLite or hold the database lock. The index is also
+     * visible to SQL on this connection as the virtual table temp.postings.
+     *
+     * @param backfill Load existing postings from SQLite. Pass false when
+     *        the index already holds them, e.g. a segment attached with
+     *        Segment::openShared, so no private copy is made.
+     */
+    bool attachIndex(std::shared_ptr<index::SegmentedIndex> index, bool backfill = true);
+
+    /**
+     * @brief Rebuild the posting index offline into a segment file
+     *
+     * Extracts every (hash, content, position) tuple, sorts them with a
+     * parallel radix sort and writes a segment that Segment::open (or
+     * TieredStore::addSegmentFile) can serve. With a memory budget in
+     * the config, sorted runs are spilled and merged out of core. The
+     * database lock is held only while reading one bounded chunk of
+     * tuples, so matches and writes go on during the build; rows stored
+     * meanwhile may or may not make it into the segment.
+     */
+    bool buildIndexSegment(
+        const std::string& path,
+        const index::IndexBuilder::Config& config = index::IndexBuilder::Config());
+
+    /**
+     * @brief Write every stored fingerprint, keyed by content row id, to a
+     *        file TieredStore::openFingerprintFile can serve
+     */
+    bool buildFingerprintFile(const std::string& path);
+
+    /**
+     * @brief Serve lookups and re-ranking from a hot/cold tiered store
+     *
+     * Postings come from the store's segment files (see buildIndexSegment)
+     * and stored fingerprints for re-ranking from its fingerprint file
+     * (see buildFingerprintFile), read from the mapping or from RAM once
+     * rebalanced hot. Content stored after the files were built is not in
+     * them: attach a SegmentedIndex with backfill = false alongside to
+     * index it; its fingerprints are then read from SQLite.
+     */
+    bool attachTieredStore(std::shared_ptr<index::TieredStore> store);
+
+    /**
+     * @brief Counter bumped by every write that can change match results
+     *
+     * Results computed at one generation may be stale at a later one.
+     */
+    uint64_t getGeneration() const {
+        return generation_.load(std::memory_order_acquire);
+    }
 
     /**
      * @brief Get content metadata by ID
      */
     std::optional<ContentMetadata> getContentById(const std::string& content_id);
 
+    /**
+     * @brief Content ID of an index posting's content (its row id)
+     */
+    std::optional<std::string> getContentIdForPosting(uint32_t content);
+
     /**
      * @brief Get database statistics
      */
@@ -88,13 +244,44 @@ public:
 
 private:
     std::string db_path_;
+    Config config_;
     sqlite3* db_;
     std::mutex db_mutex_;
 
     // Prepared statements for performance
     sqlite3_stmt* insert_content_stmt_;
     sqlite3_stmt* insert_fingerprint_stmt_;
-    sqlite3_stmt* query_fingerprints_stmt_;
+    sqlite3_stmt* clear_query_stmt_;
+    sqlite3_stmt* insert_query_hash_stmt_;
+    sqlite3_stmt* vote_candidates_stmt_;
+    sqlite3_stmt* content_rowid_stmt_;
+    sqlite3_stmt* content_by_rowid_stmt_;
+    sqlite3_stmt* insert_metadata_stmt_;
+
+    // One raw_hash statement per scoring thread: a BLOB pointer stays
+    // valid only until its statement is stepped again
+    std::vector<sqlite3_stmt*> raw_hash_stmts_;
+    std::unique_ptr<utils::ThreadPool> scoring_pool_;
+
+    std::atomic<uint64_t> generation_{0};
+
+    // Optional in-memory posting index. The owner is guarded by db_mutex_;
+    // lock-free readers go through index_ptr_. A replaced index is kept
+    // alive in retired_indexes_, since a reader may still be using it.
+    std::shared_ptr<index::SegmentedIndex> index_;
+    std::atomic<index::SegmentedIndex*> index_ptr_{nullptr};
+    std::vector<std::shared_ptr<index::SegmentedIndex>> retired_indexes_;
+
+    // Optional tiered store, published the same way as the index
+    std::shared_ptr<index::TieredStore> tiered_store_;
+    std::atomic<index::TieredStore*> tiered_store_ptr_{nullptr};
+    std::vector<std::shared_ptr<index::TieredStore>> retired_tiered_stores_;
+
+    // Bloom filter over stored hash values: query hashes it rules out
+    // never reach the vote query
+    index::BloomFilter hash_filter_;
+    size_t hash_filter_capacity_;
+    size_t hash_filter_inserts_;
 
     /**
      * @brief Execute SQL statement
@@ -110,6 +297,81 @@ private:
      * @brief Cleanup prepared statements
      */
     void cleanupStatements();
+
+    /**
+     * @brief Rebuild the stored-hash filter from SQLite (caller holds db_mutex_)
+     */
+    void rebuildHashFilter();
+
+    /**
+     * @brief Candidate content with its best-voted time offset
+     */
+    struct Candidate {
+        std::string content_id;
+        int32_t offset;       // Stored position minus query position
+        uint32_t votes;
+        double similarity;
+        bool scored;          // False if the deadline passed first
+        int64_t rowid;        // Content row id, or -1 if not known
+    };
+
+    /**
+     * @brief Score the strongest candidates and build results (caller holds db_mutex_)
+     */
+    std::vector<MatchResult> rankCandidates(
+        const core::FingerprintGenerator::Fingerprint& fingerprint,
+        std::vector<Candidate>& candidates,
+        double min_similarity,
+        size_t max_results,
+        Deadline deadline,
+        bool out_of_time,
+        bool* partial);
+
+    /**
+     * @brief Compute bitwise similarity for each candidate (caller holds db_mutex_)
+     */
+    void scoreCandidates(
+        const core::FingerprintGenerator::Fingerprint& fingerprint,
+        std::vector<Candidate>& candidates,
+        Deadline deadline);
+
+    /**
+     * @brief Score candidates[i] for i = first, first + stride, ... using one statement
+     */
+    void scoreCandidateRange(
+        const core::FingerprintGenerator::Fingerprint& fingerprint,
+        std::vector<Candidate>& candidates,
+        size_t first,
+        size_t stride,
+        sqlite3_stmt* stmt,
+        Deadline deadline);
+
+    /**
+     * @brief Row id of a content entry (caller holds db_mutex_)
+     */
+    std::optional<int64_t> getContentRowId(const std::string& content_id);
+
+    /**
+     * @brief Append every stored posting to a builder (caller holds db_mutex_)
+     */
+    bool collectPostings(index::IndexBuilder& builder);
+
+    /**
+     * @brief Append up to limit postings of fingerprint rows with id above
+     *        after_id, in id order (caller holds db_mutex_)
+     * @param last_id Set to the id of the last row read, if any; rows
+     *        whose content is gone advance it without adding a posting
+     */
+    bool readPostingChunk(
+        int64_t after_id,
+        size_t limit,
+        std::vector<index::PostingEntry>& out,
+        int64_t& last_id);
+
+    /**
+     * @brief Content ID for a row id (caller holds db_mutex_)
+     */
+    std::optional<std::string> getContentIdByRowId(int64_t rowid);
 };
 
 } // namespace database
@@ -0,0 +1,33 @@
+#ifndef INDEX_VTAB_H
+#define INDEX_VTAB_H
+
+#include "index/segmented_index.h"
+#include <sqlite3.h>
+#include <memory>
+
+namespace vfs {
+namespace database {
+
+/**
+ * @brief Register the `vfs_index` virtual table module on a connection
+ *
+ * Tables created with
+ *
+ *   CREATE VIRTUAL TABLE temp.postings USING vfs_index;
+ *
+ * expose the in-memory posting index as rows of
+ * (hash_value INTEGER, content INTEGER, position INTEGER), where
+ * `hash_value` uses the same signed 32-bit encoding as
+ * fingerprints.hash_value and `content` is the row id of the content.
+ * Equality and IN constraints on hash_value are answered with index
+ * lookups; other queries scan a snapshot of the index. No rows are
+ * copied into SQLite tables.
+ *
+ * @return true on success
+ */
+bool registerIndexModule(sqlite3* db, std::shared_ptr<index::SegmentedIndex> index);
+
+} // namespace database
+} // namespace vfs
+
+#endif // INDEX_VTAB_H
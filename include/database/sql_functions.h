@@ -0,0 +1,33 @@
+#ifndef SQL_FUNCTIONS_H
+#define SQL_FUNCTIONS_H
+
+#include <sqlite3.h>
+
+namespace vfs {
+namespace database {
+
+/**
+ * @brief Register the fingerprint SQL functions on a connection
+ *
+ * Scalar functions over raw_hash BLOBs (arrays of 32-bit sub-fingerprints);
+ * NULL unless every BLOB holds whole words:
+ *   hamming(a, b)               differing bits (NULL if the lengths differ)
+ *   hamming(a, b, offset)       differing bits with a[i] aligned to b[i + offset]
+ *   similarity(q, s, offset)    fraction of bits of q matching s at offset
+ *
+ * Aggregates over position deltas (stored position - query position),
+ * used to vote candidates inside SQLite:
+ *   offset_vote(delta)          votes of the most common delta
+ *   best_offset(delta)          the most common delta
+ *
+ * DatabaseManager registers them on its own connection; tools holding
+ * another connection to the same file can call this directly.
+ *
+ * @return true if every function was registered
+ */
+bool registerSqlFunctions(sqlite3* db);
+
+} // namespace database
+} // namespace vfs
+
+#endif // SQL_FUNCTIONS_H
@@ -0,0 +1,124 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace vfs {
+namespace index {
+
+/**
+ * @brief Cache-line blocked Bloom filter over 32-bit hashes
+ *
+ * Each key selects one 512-bit block and sets k bits inside it, so a
+ * membership test touches a single cache line and never misses on a key
+ * that was added. The block layout costs slightly more bits per key than
+ * a classic Bloom filter for the same false-positive rate, which the
+ * sizing accounts for.
+ *
+ * The encoding is a flat array of 64-bit words (Header, blocks). A filter
+ * either owns its blocks (built with a capacity and false-positive rate),
+ * kept 64-byte aligned so each one is exactly one cache line, or is
+ * attached read-only to an encoding embedded in a segment.
+ */
+class BloomFilter {
+public:
+    static constexpr size_t BLOCK_WORDS = 8;
+    static constexpr size_t HEADER_WORDS = 2;
+
+    struct Header {
+        uint64_t num_blocks;
+        uint64_t num_hashes;
+    };
+
+    /**
+     * @brief Empty filter: mayContain() is always true
+     */
+    BloomFilter() = default;
+
+    /**
+     * @brief Owning filter sized for expected_keys at the given FP rate
+     */
+    BloomFilter(size_t expected_keys, double false_positive_rate);
+
+    /**
+     * @brief Attach read-only to an encoding of num_words words
+     * @return false if the words are not a valid filter
+     */
+    bool attach(const uint64_t* words, size_t num_words);
+
+    /**
+     * @brief Add a key (owning filters only)
+     */
+    void add(uint32_t hash);
+
+    /**
+     * @brief False means the key was never added
+     */
+    bool mayContain(uint32_t hash) const {
+        const uint64_t* blocks = this->blocks();
+        if (blocks == nullptr) {
+            return true;
+        }
+
+        uint64_t h = mix(hash);
+        const uint64_t* block = blocks + blockOf(h) * BLOCK_WORDS;
+        uint32_t h1 = static_cast<uint32_t>(h);
+        uint32_t h2 = static_cast<uint32_t>((h * 0xC2B2AE3D27D4EB4Full) >> 32) | 1;
+
+        for (uint64_t i = 0; i < num_hashes_; ++i) {
+            uint32_t bit = (h1 + static_cast<uint32_t>(i) * h2) & (BLOCK_WORDS * 64 - 1);
+            if (!((block[bit / 64] >> (bit % 64)) & 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool empty() const { return blocks() == nullptr; }
+
+    /**
+     * @brief Encoding of an owned filter (header and blocks), for
+     *        embedding; empty for other filters
+     */
+    std::vector<uint64_t> encode() const;
+
+    size_t sizeBytes() const {
+        return static_cast<size_t>(num_blocks_ * BLOCK_WORDS * sizeof(uint64_t));
+    }
+
+private:
+    // One cache line of bits
+    struct alignas(64) Block {
+        uint64_t words[BLOCK_WORDS];
+    };
+    static_assert(sizeof(Block) == BLOCK_WORDS * sizeof(uint64_t), "block is one cache line");
+
+    std::vector<Block> blocks_;           // Owned blocks
+    const uint64_t* view_ = nullptr;      // Blocks of an attached encoding
+    uint64_t num_blocks_ = 0;
+    uint64_t num_hashes_ = 0;
+
+    const uint64_t* blocks() const {
+        return blocks_.empty() ? view_ : blocks_.front().words;
+    }
+
+    static uint64_t mix(uint32_t hash) {
+        // splitmix64 finaliser: sub-fingerprints are far from uniform
+        uint64_t x = hash + 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    uint64_t blockOf(uint64_t h) const {
+        // Multiply-shift range reduction of the high bits
+        return ((h >> 32) * num_blocks_) >> 32;
+    }
+};
+
+} // namespace index
+} // namespace vfs
+
+#endif // BLOOM_FILTER_H
@@ -0,0 +1,108 @@
+#ifndef ELIAS_FANO_H
+#define ELIAS_FANO_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace vfs {
+namespace index {
+
+/**
+ * @brief Read-only view of an Elias-Fano encoded monotone sequence
+ *
+ * Each of the n values in [0, universe] is split into l = log2(universe / n)
+ * low bits, stored packed, and a high part stored in unary in a bitvector
+ * of n + (universe >> l) + 1 bits: value i sets bit high(i) + i. That costs
+ * about 2 + l bits per value. Positions of every SAMPLE_RATE-th one and
+ * zero bit are sampled, so select, access and lowerBound need one sample
+ * read plus a short scan of consecutive words.
+ *
+ * The encoding is a flat array of 64-bit words (Header, low bits, high
+ * bits, samples) and can live inside a mapped segment.
+ */
+class EliasFano {
+public:
+    static constexpr size_t SAMPLE_RATE = 256;
+
+    struct Header {
+        uint64_t count;
+        uint64_t universe;
+        uint64_t low_bits;
+        uint64_t low_words;
+        uint64_t high_words;
+        uint64_t select1_samples;
+        uint64_t select0_samples;
+    };
+
+    /**
+     * @brief Streaming encoder for values pushed in non-decreasing order
+     */
+    class Encoder {
+    public:
+        Encoder(size_t count, uint64_t universe);
+
+        void push(uint64_t value);
+
+        /**
+         * @brief Finish the encoding once all count values were pushed
+         */
+        std::vector<uint64_t> finish();
+
+    private:
+        Header header_;
+        std::vector<uint64_t> low_;
+        std::vector<uint64_t> high_;
+        size_t pushed_;
+    };
+
+    /**
+     * @brief Encode a whole non-decreasing sequence
+     */
+    static std::vector<uint64_t> encode(const std::vector<uint64_t>& values);
+
+    EliasFano() = default;
+
+    /**
+     * @brief Attach to an encoding of num_words words
+     * @return false if the words are not a valid encoding
+     */
+    bool attach(const uint64_t* words, size_t num_words);
+
+    size_t size() const { return static_cast<size_t>(count_); }
+
+    /**
+     * @brief Value i
+     */
+    uint64_t access(size_t i) const;
+
+    /**
+     * @brief Values i and i + 1 with a single select
+     */
+    void accessPair(size_t i, uint64_t& first, uint64_t& second) const;
+
+    /**
+     * @brief Index of the first value >= target (size() if none)
+     * @param value Receives the value at the returned index
+     */
+    size_t lowerBound(uint64_t target, uint64_t& value) const;
+
+private:
+    uint64_t count_ = 0;
+    uint64_t universe_ = 0;
+    unsigned low_bits_ = 0;
+    const uint64_t* low_ = nullptr;
+    const uint64_t* high_ = nullptr;
+    const uint64_t* select1_ = nullptr;
+    const uint64_t* select0_ = nullptr;
+
+    uint64_t lowAt(size_t i) const;
+    size_t select1(size_t rank) const;
+    size_t select0(size_t rank) const;
+    size_t nextOne(size_t pos) const;
+};
+
+} // namespace index
+} // namespace vfs
+
+#endif // ELIAS_FANO_H
@@ -0,0 +1,135 @@
+#ifndef INDEX_BUILDER_H
+#define INDEX_BUILDER_H
+
+#include "index/segment.h"
+#include <vector>
+#include <string>
+#include <memory>
+
+namespace vfs {
+namespace index {
+
+/**
+ * @brief Offline bulk builder for posting segments
+ *
+ * Collects (hash, content, position) tuples, sorts them by hash with a
+ * parallel LSD radix sort and writes the result as a single Segment. This
+ * replaces per-posting inserts (or SQLite's single-threaded CREATE INDEX)
+ * for full rebuilds.
+ *
+ * With a memory budget the builder works out of core: whenever the
+ * in-memory batch reaches the budget it is sorted and spilled to a run
+ * file, and buildFile() k-way merges the runs straight into the output
+ * segment. Every file is read and written sequentially through buffers of
+ * io_buffer_bytes, so memory stays bounded regardless of catalog size.
+ */
+class IndexBuilder {
+public:
+    struct Config {
+        size_t num_threads;           // Sort threads (0 = hardware concurrency)
+        size_t min_parallel_entries;  // Sort single-threaded below this size
+        size_t memory_budget_bytes;   // Batch + sort buffer limit (0 = unlimited)
+        size_t io_buffer_bytes;       // Buffer per run / output stream
+        std::string spill_directory;  // Run files ("" = system temp directory)
+        Segment::Directory directory; // Directory encoding of the output
+        double filter_fpr;            // Key filter false-positive rate (0 = none)
+
+        Config()
+            : num_threads(0)
+            , min_parallel_entries(1 << 16)
+            , memory_budget_bytes(0)
+            , io_buffer_bytes(1 << 20)
+            , spill_directory()
+            , directory(Segment::Directory::Sorted)
+            , filter_fpr(0.01) {}
+    };
+
+    explicit IndexBuilder(const Config& config = Config());
+    ~IndexBuilder();
+
+    // Prevent copying
+    IndexBuilder(const IndexBuilder&) = delete;
+    IndexBuilder& operator=(const IndexBuilder&) = delete;
+
+    /**
+     * @brief Reserve space for the expected number of postings
+     *
+     * Never reserves beyond the in-memory batch limit.
+     */
+    void reserve(size_t num_postings);
+
+    /**
+     * @brief Add a single posting
+     */
+    void add(uint32_t hash, uint32_t content, uint32_t position) {
+        entries_.push_back({hash, content, position});
+        if (entries_.size() >= batch_limit_) {
+            spillRun();
+        }
+    }
+
+    /**
+     * @brief Add all sub-fingerprints of one content
+     */
+    void addFingerprint(uint32_t content, const std::vector<uint32_t>& hashes);
+
+    /**
+     * @brief Sort the collected postings and build a segment
+     *
+     * Postings with equal hashes keep the order they were added in. The
+     * builder is empty afterwards. If runs were spilled, the segment is
+     * merged into a temporary file and returned memory-mapped.
+     */
+    std::shared_ptr<const Segment> build();
+
+    /**
+     * @brief Build and write the segment to a file readable by Segment::open
+     */
+    bool buildFile(const std::string& path);
+
+    /**
+     * @brief Postings added since the last build, in memory or spilled
+     */
+    size_t size() const { return spilled_postings_ + entries_.size(); }
+
+    /**
+     * @brief Sorted runs currently spilled to disk
+     */
+    size_t numRuns() const { return runs_.size(); }
+
+    /**
+     * @brief Stable sort of entries by hash
+     *
+     * LSD radix sort over three 11-bit digits. Each pass splits the input
+     * into one chunk per thread; threads histogram their chunk, the
+     * histograms are prefix-summed in (digit, thread) order and every thread
+     * scatters its chunk to disjoint output ranges, which keeps the sort
+     * stable without any synchronisation inside a pass. Passes whose digit
+     * is constant across the input are skipped.
+     */
+    static void radixSort(std::vector<PostingEntry>& entries, size_t num_threads);
+
+private:
+    Config config_;
+    size_t batch_limit_;
+    std::vector<PostingEntry> entries_;
+    std::vector<std::string> runs_;
+    size_t spilled_postings_;
+    bool spill_failed_;
+
+    void sortEntries();
+    void spillRun();
+
+    /**
+     * @brief K-way merge all runs into a segment file
+     */
+    bool mergeRuns(const std::string& path);
+
+    std::string tempPath(const std::string& suffix);
+    void removeRuns();
+};
+
+} // namespace index
+} // namespace vfs
+
+#endif // INDEX_BUILDER_H
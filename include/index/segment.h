@@ -0,0 +1,252 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "index/elias_fano.h"
+#include "index/bloom_filter.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace vfs {
+namespace index {
+
+/**
+ * @brief Single posting: where a sub-fingerprint hash occurs
+ *
+ * `content` is the row id of the content in the `content` table and
+ * `position` the sub-fingerprint index within that content.
+ */
+struct Posting {
+    uint32_t content;
+    uint32_t position;
+};
+
+/**
+ * @brief Posting together with its hash, used while building segments
+ */
+struct PostingEntry {
+    uint32_t hash;
+    uint32_t content;
+    uint32_t position;
+};
+
+/**
+ * @brief Immutable sorted run of postings
+ *
+ * A segment is a single flat, pointer-free buffer:
+ *
+ *   Header | postings[num_postings] | keys[num_keys] | offsets[num_keys + 1]
+ *
+ * `keys` holds the distinct hashes in ascending order and `offsets[i]` the
+ * index of the first posting of `keys[i]`. Because every section is
+ * addressed by byte offset from the start of the buffer, the same bytes can
+ * be held in heap memory or mapped from a file.
+ *
+ * The directory (keys and offsets) is stored either as plain arrays, 12
+ * bytes per distinct hash with binary-search lookups, or Elias-Fano encoded,
+ * typically 2-3 bytes per distinct hash with select-based lookups.
+ *
+ * An optional Bloom filter over the keys occupies the last filter_words
+ * words of the buffer. lookup() consults it first, so hashes absent from
+ * the segment are rejected with one cache-line probe.
+ */
+class Segment {
+public:
+    static constexpr uint32_t MAGIC = 0x49534656; // "VFSI"
+    static constexpr uint32_t VERSION = 2;
+
+    enum class Directory : uint32_t {
+        Sorted = 0,     // uint32 keys[] + uint64 offsets[]
+        EliasFano = 1   // Elias-Fano encoded keys and offsets
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t directory;
+        uint32_t filter_words;  // Trailing Bloom filter words (0 = none)
+        uint64_t num_postings;
+        uint64_t num_keys;
+        uint64_t postings_offset;
+        uint64_t keys_offset;
+        uint64_t offsets_offset;
+        uint64_t total_bytes;
+    };
+
+    /**
+     * @brief Contiguous, zero-copy view of the postings for one hash
+     */
+    struct PostingRange {
+        const Posting* first;
+        const Posting* last;
+
+        const Posting* begin() const { return first; }
+        const Posting* end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+    };
+
+    /**
+     * @brief Section layout of a segment with a sorted directory
+     *
+     * Sections start on 8-byte boundaries; writers that stream a segment
+     * to disk must pad to the same offsets.
+     */
+    static Header layout(size_t num_postings, size_t num_keys);
+
+    /**
+     * @brief Section layout with explicit directory section sizes
+     */
+    static Header layout(size_t num_postings, size_t num_keys, Directory directory,
+                         size_t keys_bytes, size_t offsets_bytes, size_t filter_bytes = 0);
+
+    /**
+     * @brief Build a segment from entries sorted by hash
+     * @param entries Postings ordered by hash (ties keep their order)
+     * @param filter_fpr False-positive rate of the key filter (0 = no filter)
+     */
+    static std::shared_ptr<const Segment> build(
+        const std::vector<PostingEntry>& entries,
+        Directory directory = Directory::Sorted,
+        double filter_fpr = 0.0);
+
+    /**
+     * @brief Merge several segments into one, rebuilding the key filter
+     */
+    static std::shared_ptr<const Segment> merge(
+        const std::vector<std::shared_ptr<const Segment>>& segments,
+        Directory directory = Directory::Sorted,
+        double filter_fpr = 0.0);
+
+    /**
+     * @brief Wrap an existing segment buffer without copying it
+     * @param storage Keeps the underlying memory alive
+     * @param data Start of the segment buffer (8-byte aligned)
+     * @param size Size of the buffer in bytes
+     * @return Segment view, or nullptr if the buffer is not a valid segment
+     */
+    static std::shared_ptr<const Segment> fromBuffer(
+        std::shared_ptr<const void> storage,
+        const uint8_t* data,
+        size_t size);
+
+    /**
+     * @brief Map a segment file written by writeTo()
+     * @return Segment backed by the mapping, or nullptr on error
+     */
+    static std::shared_ptr<const Segment> open(const std::string& path);
+
+    /**
+     * @brief Attach read-only to a segment published with publishShared()
+     *
+     * Every process attaching the same name maps the same physical pages;
+     * the layout holds no pointers, so it is valid at any address.
+     * @return Segment backed by the mapping, or nullptr on error
+     */
+    static std::shared_ptr<const Segment> openShared(const std::string& name);
+
+    /**
+     * @brief Write the segment buffer to a file
+     */
+    bool writeTo(const std::string& path) const;
+
+    /**
+     * @brief Copy the segment into a new POSIX shared-memory object
+     *
+     * Fails if the name exists. To replace a published index, publish
+     * under a new name and unlink the old one; processes still attached
+     * to it keep a valid mapping until they drop it.
+     */
+    bool publishShared(const std::string& name) const;
+
+    /**
+     * @brief Remove a published segment name
+     */
+    static bool unlinkShared(const std::string& name);
+
+    /**
+     * @brief Copy the segment into a private heap buffer
+     */
+    std::shared_ptr<const Segment> copy() const;
+
+    /**
+     * @brief Find all postings for a hash
+     */
+    PostingRange lookup(uint32_t hash) const;
+
+    /**
+     * @brief False if the key filter rules the hash out
+     */
+    bool mayContain(uint32_t hash) const { return filter_.mayContain(hash); }
+
+    /**
+     * @brief Distinct hash at directory slot i
+     */
+    uint32_t keyAt(size_t i) const {
+        return compact_ ? static_cast<uint32_t>(keys_ef_.access(i)) : keys_[i];
+    }
+
+    /**
+     * @brief Postings of the hash at directory slot i
+     */
+    PostingRange postingsAt(size_t i) const {
+        if (compact_) {
+            uint64_t first;
+            uint64_t last;
+            offsets_ef_.accessPair(i, first, last);
+            return {postings_ + first, postings_ + last};
+        }
+        return {postings_ + offsets_[i], postings_ + offsets_[i + 1]};
+    }
+
+    size_t numPostings() const { return static_cast<size_t>(header_->num_postings); }
+    size_t numKeys() const { return static_cast<size_t>(header_->num_keys); }
+    size_t sizeBytes() const { return static_cast<size_t>(header_->total_bytes); }
+    const uint8_t* data() const { return data_; }
+
+    Directory directory() const { return static_cast<Directory>(header_->directory); }
+
+    /**
+     * @brief Bytes used by the keys and offsets sections
+     */
+    size_t directoryBytes() const {
+        return static_cast<size_t>(header_->total_bytes - header_->keys_offset) - filterBytes();
+    }
+
+    size_t filterBytes() const {
+        return static_cast<size_t>(header_->filter_words) * sizeof(uint64_t);
+    }
+
+private:
+    Segment() = default;
+
+    std::shared_ptr<const void> storage_;
+    const uint8_t* data_ = nullptr;
+    const Header* header_ = nullptr;
+    const Posting* postings_ = nullptr;
+    const uint32_t* keys_ = nullptr;
+    const uint64_t* offsets_ = nullptr;
+    bool compact_ = false;
+    EliasFano keys_ef_;
+    EliasFano offsets_ef_;
+    BloomFilter filter_;
+
+    /**
+     * @brief Allocate a segment buffer from a directory and fill its postings
+     * @param fill Writes exactly offsets.back() postings to the given array
+     */
+    template<typename Fill>
+    static std::shared_ptr<const Segment> assemble(
+        const std::vector<uint32_t>& keys,
+        const std::vector<uint64_t>& offsets,
+        Directory directory,
+        double filter_fpr,
+        Fill&& fill);
+};
+
+} // namespace index
+} // namespace vfs
+
+#endif // SEGMENT_H
@@ -0,0 +1,184 @@
+#ifndef SEGMENTED_INDEX_H
+#define SEGMENTED_INDEX_H
+
+#include "index/segment.h"
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+namespace vfs {
+namespace index {
+
+/**
+ * @brief LSM-style in-memory posting index
+ *
+ * New postings go to a mutable memtable. A full memtable is frozen and
+ * flushed to an immutable sorted Segment, and segments of similar size are
+ * merged by a background worker (size-tiered compaction). Lookups fan out
+ * across the memtables and a snapshot of the segment list, so ingest and
+ * queries only contend on short memtable critical sections.
+ */
+class SegmentedIndex {
+public:
+    struct Config {
+        size_t memtable_max_postings;  // Freeze memtable beyond this size
+        size_t merge_fanout;           // Merge once a tier holds this many segments
+        size_t tier_base_postings;     // Upper size bound of the smallest tier
+        bool background_merges;        // Flush/merge on a worker thread
+        Segment::Directory directory;  // Directory encoding of new segments
+        double filter_fpr;             // Per-segment key filter FP rate (0 = none)
+
+        Config()
+            : memtable_max_postings(1 << 20)
+            , merge_fanout(4)
+            , tier_base_postings(1 << 20)
+            , background_merges(true)
+            , directory(Segment::Directory::Sorted)
+            , filter_fpr(0.01) {}
+    };
+
+    struct Stats {
+        uint64_t total_postings;
+        uint64_t memtable_postings;
+        uint64_t num_segments;
+        uint64_t segment_bytes;
+        uint64_t filter_bytes;
+        uint64_t flushes;
+        uint64_t merges;
+    };
+
+    using SegmentList = std::vector<std::shared_ptr<const Segment>>;
+
+    /**
+     * @brief Consistent point-in-time view of the whole index
+     */
+    struct Snapshot {
+        std::vector<PostingEntry> memtable;          // Copied, in no particular order
+        std::shared_ptr<const SegmentList> segments; // Shared, not copied
+    };
+
+    explicit SegmentedIndex(const Config& config = Config());
+    ~SegmentedIndex();
+
+    // Prevent copying
+    SegmentedIndex(const SegmentedIndex&) = delete;
+    SegmentedIndex& operator=(const SegmentedIndex&) = delete;
+
+    /**
+     * @brief Add a single posting
+     */
+    void add(uint32_t hash, uint32_t content, uint32_t position);
+
+    /**
+     * @brief Add all sub-fingerprints of one content
+     */
+    void addFingerprint(uint32_t content, const std::vector<uint32_t>& hashes);
+
+    /**
+     * @brief Add an already built segment (e.g. from an offline build)
+     *
+     * Added segments are served as they are and never merged, so one
+     * mapped from a file or shared memory is not copied into the heap.
+     */
+    void addSegment(std::shared_ptr<const Segment> segment);
+
+    /**
+     * @brief Append all postings for a hash to out
+     */
+    void lookup(uint32_t hash, std::vector<Posting>& out) const;
+
+    /**
+     * @brief Freeze the current memtable and schedule its flush
+     */
+    void flush();
+
+    /**
+     * @brief Block until all pending flushes and merges are done
+     */
+    void waitForBackgroundWork();
+
+    /**
+     * @brief Snapshot of the current immutable segments
+     */
+    std::shared_ptr<const SegmentList> segments() const;
+
+    /**
+     * @brief Copy the memtables and pin the current segments, for full scans
+     */
+    Snapshot snapshot() const;
+
+    Stats getStats() const;
+
+private:
+    using Memtable = std::unordered_map<uint32_t, std::vector<Posting>>;
+
+    Config config_;
+
+    // Active memtable plus frozen memtables waiting to be flushed
+    mutable std::shared_mutex memtable_mutex_;
+    std::shared_ptr<Memtable> active_;
+    size_t active_postings_;
+    std::vector<std::shared_ptr<const Memtable>> frozen_;
+    size_t frozen_postings_;
+
+    // Published segments, replaced copy-on-write
+    mutable std::mutex segments_mutex_;
+    std::shared_ptr<const SegmentList> segments_;
+    std::unordered_set<const Segment*> pinned_;   // From addSegment; never merged
+
+    // Serializes flushes and merges
+    std::mutex maintenance_mutex_;
+
+    // Background worker
+    std::thread worker_;
+    std::mutex work_mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    bool stop_;
+    bool pending_;
+    bool busy_;
+
+    // Statistics
+    std::atomic<uint64_t> total_postings_{0};
+    std::atomic<uint64_t> flushes_{0};
+    std::atomic<uint64_t> merges_{0};
+
+    /**
+     * @brief Freeze the active memtable (caller holds memtable_mutex_)
+     */
+    void freezeLocked();
+
+    /**
+     * @brief Flush the oldest frozen memtable, if any
+     */
+    bool flushOne();
+
+    /**
+     * @brief Merge one over-full size tier, if any
+     */
+    bool mergeOne();
+
+    /**
+     * @brief Run flushes and merges until there is nothing left to do
+     */
+    void runPendingWork();
+
+    /**
+     * @brief Size tier of a segment
+     */
+    size_t tierOf(const Segment& segment) const;
+
+    void workerThread();
+    void notifyWorker();
+};
+
+} // namespace index
+} // namespace vfs
+
+#endif // SEGMENTED_INDEX_H
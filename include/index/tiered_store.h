@@ -0,0 +1,177 @@
+#ifndef TIERED_STORE_H
+#define TIERED_STORE_H
+
+#include "index/segment.h"
+#include "utils/mapped_file.h"
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+namespace vfs {
+namespace index {
+
+/**
+ * @brief Hot/cold storage for posting segments and fingerprint BLOBs
+ *
+ * Everything lives in memory-mapped files (the cold tier) and is served
+ * straight from the page cache. Access counters track which segments and
+ * which contents' fingerprints are actually used; rebalance() copies the
+ * hottest of them into private RAM up to a byte budget and drops the rest
+ * back to the mapping. Counters decay on every rebalance, so the RAM tier
+ * follows the current working set rather than the catalog size.
+ *
+ * Lookups never rebalance themselves: once rebalance_interval accesses
+ * have been counted, a background thread does it, so no lookup waits on
+ * the copies.
+ */
+class TieredStore {
+public:
+    struct Config {
+        size_t hot_budget_bytes;       // RAM available to the hot tier
+        double counter_decay;          // Multiplier applied to counters on rebalance
+        uint64_t rebalance_interval;   // Accesses between background rebalances (0 = manual)
+
+        Config()
+            : hot_budget_bytes(256ull << 20)
+            , counter_decay(0.5)
+            , rebalance_interval(100000) {}
+    };
+
+    /**
+     * @brief Zero-copy view of one stored fingerprint
+     */
+    struct FingerprintView {
+        const uint32_t* data;
+        size_t size;
+        std::shared_ptr<const void> storage;  // Keeps data valid
+
+        bool empty() const { return size == 0; }
+    };
+
+    struct Stats {
+        uint64_t hot_bytes;
+        uint64_t cold_bytes;
+        uint64_t hot_segments;
+        uint64_t hot_fingerprints;
+        uint64_t hot_hits;
+        uint64_t cold_hits;
+        uint64_t promotions;
+        uint64_t demotions;
+    };
+
+    explicit TieredStore(const Config& config = Config());
+    ~TieredStore();
+
+    // Prevent copying
+    TieredStore(const TieredStore&) = delete;
+    TieredStore& operator=(const TieredStore&) = delete;
+
+    /**
+     * @brief Write fingerprints to a file loadable by openFingerprintFile()
+     * @param fingerprints Sub-fingerprint hashes keyed by content row id
+     */
+    static bool writeFingerprintFile(
+        const std::string& path,
+        const std::map<uint32_t, std::vector<uint32_t>>& fingerprints);
+
+    /**
+     * @brief Add a segment file to the cold tier
+     */
+    bool addSegmentFile(const std::string& path);
+
+    /**
+     * @brief Serve fingerprints from a file written by writeFingerprintFile()
+     */
+    bool openFingerprintFile(const std::string& path);
+
+    /**
+     * @brief Append all postings for a hash to out
+     */
+    void lookup(uint32_t hash, std::vector<Posting>& out);
+
+    /**
+     * @brief Get the stored fingerprint of a content (empty if unknown)
+     */
+    FingerprintView getFingerprint(uint32_t content);
+
+    /**
+     * @brief Promote the hottest data into RAM and demote the rest
+     *
+     * Mappings of promoted segments are advised away, and those of
+     * demoted ones read ahead, so the page cache follows the tiers.
+     */
+    void rebalance();
+
+    Stats getStats() const;
+
+private:
+    struct TieredSegment {
+        std::shared_ptr<const utils::MappedFile> file;  // Backs cold
+        std::shared_ptr<const Segment> cold;
+        std::shared_ptr<const Segment> hot;
+        std::atomic<uint64_t> accesses{0};
+    };
+
+    struct FingerprintSlot {
+        uint32_t content;
+        uint32_t count;
+        uint64_t offset;  // In words, relative to the data section
+    };
+
+    Config config_;
+
+    // Guards the hot pointers; held shared by readers
+    mutable std::shared_mutex tier_mutex_;
+    std::vector<std::unique_ptr<TieredSegment>> segments_;
+
+    std::shared_ptr<utils::MappedFile> fingerprint_file_;
+    const FingerprintSlot* fingerprint_slots_;
+    size_t num_fingerprints_;
+    const uint32_t* fingerprint_data_;
+    std::vector<std::shared_ptr<const std::vector<uint32_t>>> hot_fingerprints_;
+    std::unique_ptr<std::atomic<uint64_t>[]> fingerprint_accesses_;
+    uint64_t fingerprint_epoch_ = 0;   // Bumped when the fingerprint file is replaced
+
+    std::mutex rebalance_mutex_;
+    std::atomic<uint64_t> accesses_since_rebalance_{0};
+
+    // Background rebalancing, started when rebalance_interval > 0
+    std::mutex maintenance_mutex_;
+    std::condition_variable maintenance_cv_;
+    bool rebalance_due_ = false;
+    bool stopping_ = false;
+    std::thread maintenance_thread_;
+
+    // Statistics
+    std::atomic<uint64_t> hot_bytes_{0};
+    std::atomic<uint64_t> hot_hits_{0};
+    std::atomic<uint64_t> cold_hits_{0};
+    std::atomic<uint64_t> promotions_{0};
+    std::atomic<uint64_t> demotions_{0};
+
+    /**
+     * @brief Count an access and wake the background thread when the
+     *        interval is reached
+     */
+    void recordAccess();
+
+    /**
+     * @brief Background thread: rebalance whenever one is due
+     */
+    void maintenanceLoop();
+
+    /**
+     * @brief Rebalance; caller holds rebalance_mutex_
+     */
+    void rebalanceLocked();
+};
+
+} // namespace index
+} // namespace vfs
+
+#endif // TIERED_STORE_H
@@ -5,11 +5,18 @@
 #include "database/database_manager.h"
 #include "utils/thread_pool.h"
 #include "monitoring/metrics.h"
+#include "monitoring/latency_histogram.h"
+#include "matcher/result_cache.h"
+#include "matcher/stream_monitor.h"
 #include <memory>
 #include <future>
 #include <atomic>
-#include <list>
 #include <optional>
+#include <unordered_map>
+#include <condition_variable>
+#include <array>
+#include <deque>
+#include <functional>
 
 namespace vfs {
 namespace matcher {
@@ -22,35 +29,87 @@ namespace matcher {
  */
 class MatcherService {
 public:
+    /**
+     * @brief Scheduling class of a request, most urgent first
+     */
+    enum class Priority {
+        Live,     // Broadcast monitoring: latency-critical
+        Normal,
+        Batch     // Bulk back-catalog scans
+    };
+    static constexpr size_t NUM_PRIORITIES = 3;
+
     struct MatchRequest {
         std::string request_id;
         core::FingerprintGenerator::Fingerprint fingerprint;
-        double min_similarity;
-        size_t max_results;
+        double min_similarity = 0.0;     // 0 = Config::default_min_similarity
+        size_t max_results = 0;          // 0 = Config::default_max_results
+        
+        // Past this point the request is answered with what was found so
+        // far, or dropped if it has not started; max() means no deadline
+        database::DatabaseManager::Deadline deadline =
+            database::DatabaseManager::Deadline::max();
+        
+        Priority priority = Priority::Normal;
     };
 
     struct MatchResponse {
         std::string request_id;
-        std::vector<database::DatabaseManager::MatchResult> matches;
+        SharedResults matches;           // Shared with the cache; never modified
         uint64_t processing_time_us;
         bool success;
+        bool partial;                    // Deadline hit: best matches found in time
         std::string error_message;
     };
 
+    /**
+     * @brief What matchAsync does when the admission queue is full
+     */
+    enum class AdmissionPolicy {
+        Reject,   // Fail fast with an overload response
+        Block     // Wait for room, up to admission_timeout_ms or the deadline
+    };
+
     struct Config {
         size_t num_threads;
         size_t cache_size;
+        size_t cache_max_bytes;          // Estimated cache memory budget (0 = unbounded)
+        uint64_t cache_ttl_ms;           // Cached result lifetime (0 = no expiry)
+        bool invalidate_cache_on_ingest; // Drop results computed before a DB write
+        size_t cache_shards;             // Independently locked cache stripes
         bool enable_caching;
+        bool enable_coalescing;          // Identical concurrent misses share one query
+        double near_duplicate_similarity; // Reuse results of a query this close (0 = exact only)
         double default_min_similarity;
         size_t default_max_results;
+        size_t max_queued_requests;      // Submitted but not started (0 = unbounded)
+        AdmissionPolicy admission_policy;
+        uint64_t admission_timeout_ms;   // Longest Block wait for a queue slot
+        uint64_t priority_aging_ms;      // Queued this long, a request runs regardless of class
+        size_t parallel_query_threshold; // Hashes from which a query is voted across the pool (0 = never)
+        size_t parallel_query_chunk;     // Hashes per parallel vote task
+        bool shared_batch_lookups;       // matchBatch looks each distinct hash up once
         
         // Default constructor with default values
         Config() 
             : num_threads(8)
             , cache_size(10000)
+            , cache_max_bytes(256 << 20)
+            , cache_ttl_ms(0)
+            , invalidate_cache_on_ingest(true)
+            , cache_shards(16)
             , enable_caching(true)
+            , enable_coalescing(true)
+            , near_duplicate_similarity(0.0)
             , default_min_similarity(0.7)
-            , default_max_results(10) {}
+            , default_max_results(10)
+            , max_queued_requests(0)
+            , admission_policy(AdmissionPolicy::Reject)
+            , admission_timeout_ms(100)
+            , priority_aging_ms(250)
+            , parallel_query_threshold(4096)
+            , parallel_query_chunk(1024)
+            , shared_batch_lookups(true) {}
     };
     
     MatcherService(
@@ -66,28 +125,70 @@ public:
 
     /**
      * @brief Process match request asynchronously
+     *
+     * Queued requests start in priority order. A request that has waited
+     * priority_aging_ms starts ahead of any class, oldest first, so a
+     * stream of live traffic cannot starve a batch indefinitely.
+     *
+     * With max_queued_requests set, a request that finds the queue full
+     * is rejected or waits per the admission policy. A rejected request
+     * completes immediately with success = false.
+     *
+     * The request is moved into the queue; pass an rvalue to avoid
+     * copying its fingerprint.
      */
-    std::future<MatchResponse> matchAsync(const MatchRequest& request);
+    std::future<MatchResponse> matchAsync(MatchRequest request);
 
     /**
      * @brief Process batch of requests
+     *
+     * Requests are admitted as queue slots free up; a batch is never
+     * rejected for being larger than the queue.
+     *
+     * With an attached index and shared_batch_lookups, cache misses are
+     * instead answered together: the batch's hashes are deduplicated,
+     * each posting list is read once and its votes go to every query
+     * containing the hash. The batch takes one queue slot and starts as
+     * a Batch-priority task, so live traffic still goes first; its
+     * lookups and rankings are then spread across idle workers.
      */
     std::vector<MatchResponse> matchBatch(const std::vector<MatchRequest>& requests);
 
+    /**
+     * @brief Live multi-channel monitor matching against this service's database
+     *
+     * The monitor runs on its own pinned workers, not the request pool.
+     */
+    std::unique_ptr<StreamMonitor> createStreamMonitor(
+        StreamMonitor::EventHandler handler,
+        const StreamMonitor::Config& config = StreamMonitor::Config());
+
     /**
      * @brief Get service statistics
      */
     struct ServiceStats {
         uint64_t total_requests;
         uint64_t successful_matches;
-        uint64_t cache_hits;
+        uint64_t cache_hits;             // Includes near-duplicate hits
+        uint64_t cache_near_hits;
         uint64_t cache_misses;
+        uint64_t cache_bytes;
+        uint64_t coalesced_requests;     // Served by an identical in-flight query
+        uint64_t partial_matches;        // Cut short by their deadline
+        uint64_t expired_requests;       // Dropped: deadline passed before start
+        uint64_t rejected_requests;      // Turned away by admission control
+        uint64_t queue_depth;            // Admitted but not yet started
         double avg_latency_us;
         double p95_latency_us;
         double p99_latency_us;
     };
     ServiceStats getStats() const;
 
+    /**
+     * @brief Per-shard hit, miss and eviction counts of the result cache
+     */
+    std::vector<ResultCache::ShardStats> getCacheShardStats() const;
+
     /**
      * @brief Clear cache
      */
@@ -99,42 +200,131 @@ private:
     std::unique_ptr<utils::ThreadPool> thread_pool_;
     Config config_;
 
-    // LRU Cache for hot fingerprints
-    struct CacheEntry {
-        std::vector<database::DatabaseManager::MatchResult> results;
-        std::chrono::steady_clock::time_point timestamp;
+    // Sharded LRU cache for hot fingerprints
+    std::unique_ptr<ResultCache> cache_;
+
+    // Queries being answered right now, by cache key; duplicates that
+    // arrive meanwhile wait on the leader's results instead of querying
+    struct FlightResult {
+        SharedResults matches;
+        bool partial;
     };
-    
-    mutable std::mutex cache_mutex_;
-    std::unordered_map<std::string, CacheEntry> cache_;
-    std::list<std::string> cache_lru_;
+    struct InFlight {
+        std::shared_future<FlightResult> results;
+        uint64_t generation;
+        database::DatabaseManager::Deadline deadline;
+    };
+    std::mutex inflight_mutex_;
+    std::unordered_map<ResultCache::Key, InFlight> inflight_;
+
+    // Run queues, one per priority. Each queued request also submits one
+    // pool task, which runs whichever request is due when it starts.
+    struct QueuedRequest {
+        MatchRequest request;
+        std::promise<MatchResponse> promise;
+        std::chrono::steady_clock::time_point enqueued;
+        std::function<void()> task;   // Set for a shared batch; run instead of request
+    };
+    std::mutex schedule_mutex_;
+    std::array<std::deque<QueuedRequest>, NUM_PRIORITIES> run_queues_;
+
+    // Admission control: requests submitted to the pool but not started
+    std::mutex admission_mutex_;
+    std::condition_variable admission_cv_;
+    std::atomic<size_t> queued_{0};
 
     // Statistics
-    mutable std::mutex stats_mutex_;
     std::atomic<uint64_t> total_requests_{0};
     std::atomic<uint64_t> successful_matches_{0};
     std::atomic<uint64_t> cache_hits_{0};
+    std::atomic<uint64_t> cache_near_hits_{0};
     std::atomic<uint64_t> cache_misses_{0};
-    std::vector<uint64_t> latencies_;
+    std::atomic<uint64_t> coalesced_requests_{0};
+    std::atomic<uint64_t> partial_matches_{0};
+    std::atomic<uint64_t> expired_requests_{0};
+    std::atomic<uint64_t> rejected_requests_{0};
+    monitoring::LatencyHistogram latencies_;   // Bounded; lock-free to record
+
+    /**
+     * @brief Take a queue slot, waiting until the given time if it is full
+     * @return false if no slot became free in time
+     */
+    bool admit(std::chrono::steady_clock::time_point wait_until);
+
+    /**
+     * @brief Free a queue slot once its request starts
+     */
+    void release();
+
+    /**
+     * @brief Queue a request that already holds a slot
+     */
+    std::future<MatchResponse> enqueue(MatchRequest request);
+
+    /**
+     * @brief Put a work item on its priority's run queue and wake a worker
+     */
+    void schedule(QueuedRequest queued);
+
+    /**
+     * @brief Answer a batch with one lookup per distinct hash
+     */
+    std::vector<MatchResponse> matchBatchShared(const std::vector<MatchRequest>& requests);
+
+    /**
+     * @brief Run body(0) .. body(count - 1) on the caller and idle pool workers
+     *
+     * The caller claims items too, so it never waits on a helper that has
+     * not started. The first exception thrown by body is rethrown here.
+     */
+    void parallelFor(size_t count, std::function<void(size_t)> body);
+
+    /**
+     * @brief Pop the request that is due and process it (pool task)
+     */
+    void runNext();
+
+    /**
+     * @brief Query the database, splitting a long query's votes across the pool
+     *
+     * With an attached index, a query of at least parallel_query_threshold
+     * hashes is cut into chunks that idle workers and the caller vote on
+     * concurrently; the merged votes are ranked once. The caller claims
+     * chunks too, so it never waits on a helper that has not started.
+     */
+    std::vector<database::DatabaseManager::MatchResult> queryDatabase(
+        const MatchRequest& request,
+        double min_similarity,
+        size_t max_results,
+        bool* partial);
 
     /**
      * @brief Check cache for fingerprint
      */
-    std::optional<std::vector<database::DatabaseManager::MatchResult>>
-    checkCache(const std::string& cache_key);
+    ResultCache::Results checkCache(ResultCache::Key cache_key, uint64_t generation);
 
     /**
      * @brief Update cache with new results
      */
     void updateCache(
-        const std::string& cache_key,
-        const std::vector<database::DatabaseManager::MatchResult>& results);
+        ResultCache::Key cache_key,
+        const SharedResults& results,
+        uint64_t generation,
+        const ResultCache::Signature* signature,
+        const std::vector<uint32_t>& query);
+
+    /**
+     * @brief Digest of the match parameters (near-duplicate signature salt)
+     */
+    static uint64_t paramsDigest(double min_similarity, size_t max_results);
 
     /**
-     * @brief Generate cache key from fingerprint
+     * @brief Digest of every sub-fingerprint and the match parameters
      */
-    std::string generateCacheKey(
-        const core::FingerprintGenerator::Fingerprint& fingerprint) const;
+    ResultCache::Key generateCacheKey(
+        const core::FingerprintGenerator::Fingerprint& fingerprint,
+        double min_similarity,
+        size_t max_results) const;
 
     /**
      * @brief Process single match request (internal)
@@ -0,0 +1,248 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "database/database_manager.h"
+#include <vector>
+#include <list>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+
+namespace vfs {
+namespace matcher {
+
+/**
+ * @brief Read-only handle on an immutable set of match results
+ *
+ * Copies share one set, so serving cached results to many responses costs
+ * a reference count each rather than a deep copy. A default handle is
+ * empty.
+ */
+class SharedResults {
+public:
+    using ResultSet = std::vector<database::DatabaseManager::MatchResult>;
+    using const_iterator = ResultSet::const_iterator;
+
+    SharedResults() = default;
+    SharedResults(std::shared_ptr<const ResultSet> results) : results_(std::move(results)) {}
+    explicit SharedResults(ResultSet results)
+        : results_(std::make_shared<const ResultSet>(std::move(results))) {}
+
+    size_t size() const { return get().size(); }
+    bool empty() const { return get().empty(); }
+    const database::DatabaseManager::MatchResult& operator[](size_t i) const { return get()[i]; }
+    const_iterator begin() const { return get().begin(); }
+    const_iterator end() const { return get().end(); }
+
+    const ResultSet& get() const;
+    const std::shared_ptr<const ResultSet>& shared() const { return results_; }
+
+private:
+    std::shared_ptr<const ResultSet> results_;
+};
+
+/**
+ * @brief Lock-striped LRU cache of match results
+ *
+ * Keys are 64-bit query digests, spread over independently locked shards
+ * so lookups from different worker threads rarely wait on each other.
+ * Each shard is an O(1) LRU: entries hold their position in the shard's
+ * recency list. Entry and byte budgets are split evenly across shards, so
+ * eviction order is LRU per shard rather than globally.
+ *
+ * Entries also go stale. They expire after a TTL, and each one records the
+ * database generation its results were computed at; a lookup at a later
+ * generation drops it, so content stored since is never missed.
+ *
+ * Optionally the cache also answers near-duplicate queries. Entries are
+ * indexed by min-hash bands over their sub-fingerprint sets, which survive
+ * a few flipped bits or dropped frames. A band match is only a candidate:
+ * it is served after the two queries agree bitwise at a small frame shift.
+ */
+class ResultCache {
+public:
+    using Key = uint64_t;
+    using ResultSet = SharedResults::ResultSet;
+    using Results = std::shared_ptr<const ResultSet>;   // Shared with every hit; never modified
+
+    static constexpr size_t SIGNATURE_BANDS = 8;
+    static constexpr size_t ROWS_PER_BAND = 2;
+
+    struct Config {
+        size_t capacity;                  // Entries across all shards
+        size_t max_bytes;                 // Estimated memory across all shards (0 = unbounded)
+        std::chrono::milliseconds ttl;    // Entry lifetime (0 = no expiry)
+        size_t num_shards;                // Rounded down to a power of two
+        double near_duplicate_similarity; // Bit agreement to reuse a near query (0 = off)
+        size_t near_duplicate_max_shift;  // Frame shifts tried when verifying
+
+        Config()
+            : capacity(10000)
+            , max_bytes(0)
+            , ttl(0)
+            , num_shards(16)
+            , near_duplicate_similarity(0.0)
+            , near_duplicate_max_shift(4) {}
+    };
+
+    /**
+     * @brief Min-hash band keys of one query
+     */
+    struct Signature {
+        std::array<uint64_t, SIGNATURE_BANDS> bands;
+        uint64_t salt;   // Match parameters; only equal salts are comparable
+    };
+
+    struct ShardStats {
+        uint64_t hits;
+        uint64_t near_hits;      // Served by lookupSimilar after an exact miss
+        uint64_t misses;         // Exact-key misses
+        uint64_t evictions;      // Made room under the entry or byte budget
+        uint64_t expirations;    // Dropped past the TTL or an older generation
+        size_t entries;
+        size_t bytes;
+    };
+
+    /**
+     * @brief Cache over the configured number of shards
+     *
+     * The shard count never exceeds capacity, so every shard can hold at
+     * least one entry.
+     */
+    explicit ResultCache(const Config& config = Config());
+
+    // Prevent copying
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    /**
+     * @brief Cached results for a key, marking it most recently used
+     *
+     * Entries computed before generation or past their TTL are dropped.
+     * A hit shares the cached set; a miss returns null.
+     */
+    Results lookup(Key key, uint64_t generation = 0);
+
+    /**
+     * @brief Cached results of a verified near-duplicate of query
+     *
+     * Returns null when near-duplicate matching is off.
+     */
+    Results lookupSimilar(
+        const Signature& signature,
+        const std::vector<uint32_t>& query,
+        uint64_t generation = 0);
+
+    /**
+     * @brief Insert or refresh a key, evicting LRU entries until it fits
+     *
+     * generation is the database generation read before the results were
+     * computed. An entry larger than a shard's byte budget is not cached.
+     * With a signature and query the entry can also serve near-duplicates.
+     * Byte budgets count each entry's set, though evicted sets live on
+     * while responses still hold them.
+     */
+    void insert(Key key, Results results,
+                uint64_t generation = 0,
+                const Signature* signature = nullptr,
+                const std::vector<uint32_t>* query = nullptr);
+
+    /**
+     * @brief Drop every entry (statistics are kept)
+     */
+    void clear();
+
+    size_t size() const;
+    size_t sizeBytes() const;
+    size_t numShards() const { return shards_.size(); }
+    bool nearDuplicatesEnabled() const { return config_.near_duplicate_similarity > 0.0; }
+
+    /**
+     * @brief Hit, miss and eviction counts of each shard
+     */
+    std::vector<ShardStats> getShardStats() const;
+
+    /**
+     * @brief Min-hash signature of a sub-fingerprint set
+     */
+    static Signature signature(const std::vector<uint32_t>& hashes, uint64_t salt);
+
+private:
+    struct Entry {
+        Results results;
+        std::chrono::steady_clock::time_point timestamp;
+        std::list<Key>::iterator lru_position;
+        uint64_t generation;
+        size_t bytes;   // Estimated footprint, including container nodes
+
+        // Set only for entries that can serve near-duplicates; shared so
+        // lookupSimilar can verify it after dropping the shard lock
+        std::shared_ptr<const std::vector<uint32_t>> query;
+        std::optional<Signature> signature;
+    };
+
+    // Shards sit on their own cache lines so their locks do not false-share
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, Entry> entries;
+        std::list<Key> lru;   // Most recent first
+        size_t capacity = 0;
+        size_t byte_capacity = 0;   // 0 = unbounded
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t near_hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t expirations = 0;
+    };
+
+    // Band key -> most recent entry with that band, striped like the
+    // shards. An entry's bands change only under its shard lock, taken
+    // before any stripe lock.
+    struct alignas(64) BandStripe {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Key> keys;
+    };
+
+    Config config_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<std::unique_ptr<BandStripe>> bands_;
+    unsigned shard_bits_;
+
+    Shard& shardFor(Key key);
+    BandStripe& stripeFor(uint64_t band_key);
+
+    void indexBands(Key key, const Signature& signature);
+    void unindexBands(Key key, const Signature& signature);
+
+    /**
+     * @brief Whether an entry can no longer be served
+     */
+    bool isStale(const Entry& entry, uint64_t generation,
+                 std::chrono::steady_clock::time_point now) const;
+
+    /**
+     * @brief Erase an entry (caller holds the shard lock)
+     *
+     * Its band keys, if any, are returned for the caller to unindex
+     * before releasing the lock.
+     */
+    std::optional<Signature> removeEntry(
+        Shard& shard, std::unordered_map<Key, Entry>::iterator it);
+
+    static size_t estimateBytes(const Entry& entry);
+
+    /**
+     * @brief Bit agreement of two queries at their best small shift
+     */
+    double querySimilarity(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) const;
+};
+
+} // namespace matcher
+} // namespace vfs
+
+#endif // RESULT_CACHE_H
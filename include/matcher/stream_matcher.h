@@ -0,0 +1,178 @@
+#ifndef STREAM_MATCHER_H
+#define STREAM_MATCHER_H
+
+#include "database/database_manager.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace vfs {
+namespace matcher {
+
+/**
+ * @brief Postings of a set of hashes, each resolved once
+ *
+ * Lets several stream sessions share one index lookup per distinct hash.
+ */
+class PostingBatch {
+public:
+    /**
+     * @brief Queue a hash for resolution (duplicates are fine)
+     */
+    void add(uint32_t hash) { hashes_.push_back(hash); }
+
+    /**
+     * @brief Look every distinct queued hash up once
+     */
+    void resolve(database::DatabaseManager& db_manager);
+
+    /**
+     * @brief Postings of a resolved hash, capped as voting uses them
+     */
+    std::pair<const index::Posting*, size_t> find(uint32_t hash) const;
+
+    /**
+     * @brief Distinct hashes resolved
+     */
+    size_t lookups() const { return hashes_.size(); }
+
+    void clear();
+
+private:
+    std::vector<uint32_t> hashes_;        // Sorted and unique once resolved
+    std::vector<size_t> begins_;          // Postings of hashes_[i]: [begins_[i], begins_[i + 1])
+    std::vector<index::Posting> postings_;
+};
+
+/**
+ * @brief Continuous matching session over one live stream
+ *
+ * Sub-fingerprints are pushed as they are produced. Each one is looked up
+ * in the database's posting index exactly once, and its hits vote for
+ * (content, time offset) pairs. Votes are kept for the last window_hashes
+ * sub-fingerprints only: as a hash leaves the window its votes are taken
+ * back, so the cost per push is proportional to the new audio.
+ *
+ * A content starts matching when one offset gathers start_votes within
+ * the window, and stops when that offset falls below end_votes. Events
+ * are returned by the push that caused them.
+ *
+ * Needs an index attached to the database; without one nothing votes.
+ * A session is not thread-safe: feed each stream from one thread.
+ */
+class StreamMatcher {
+public:
+    struct Config {
+        size_t window_hashes;   // Sub-fingerprints whose votes are kept
+        uint32_t start_votes;   // Votes at one offset to report a match
+        uint32_t end_votes;     // Below this the match has ended (hysteresis)
+
+        Config()
+            : window_hashes(512)
+            , start_votes(16)
+            , end_votes(8) {}
+    };
+
+    enum class EventType {
+        Start,
+        End
+    };
+
+    struct MatchEvent {
+        EventType type;
+        std::string content_id;
+        uint64_t stream_position;    // Sub-fingerprints pushed when it fired
+        int64_t content_position;    // Matching position in the content then
+        uint32_t votes;              // Window votes at the matched offset
+    };
+
+    struct ActiveMatch {
+        std::string content_id;
+        uint64_t start_position;     // Stream position of the Start event
+        int64_t offset;              // Content position minus stream position
+        uint32_t votes;
+    };
+
+    explicit StreamMatcher(
+        std::shared_ptr<database::DatabaseManager> db_manager,
+        const Config& config = Config());
+
+    // Prevent copying
+    StreamMatcher(const StreamMatcher&) = delete;
+    StreamMatcher& operator=(const StreamMatcher&) = delete;
+
+    /**
+     * @brief Append sub-fingerprints to the stream
+     * @return Match start and end events, in stream order
+     */
+    std::vector<MatchEvent> push(const std::vector<uint32_t>& hashes);
+
+    /**
+     * @brief Append sub-fingerprints whose postings a batch already holds
+     */
+    std::vector<MatchEvent> push(const std::vector<uint32_t>& hashes, const PostingBatch& batch);
+
+    /**
+     * @brief End the stream, closing every active match
+     */
+    std::vector<MatchEvent> finish();
+
+    /**
+     * @brief Sub-fingerprints pushed so far
+     */
+    uint64_t position() const { return position_; }
+
+    /**
+     * @brief Matches started and not yet ended
+     */
+    std::vector<ActiveMatch> activeMatches() const;
+
+private:
+    // One posting hit of a windowed sub-fingerprint
+    struct Hit {
+        uint32_t content;
+        int64_t offset;
+    };
+
+    struct Active {
+        std::string content_id;
+        uint64_t start_position;
+        int64_t offset;
+    };
+
+    using OffsetVotes = std::unordered_map<int64_t, uint32_t>;
+
+    std::shared_ptr<database::DatabaseManager> db_manager_;
+    Config config_;
+    uint64_t position_ = 0;
+
+    std::deque<std::vector<Hit>> window_;   // Oldest first
+    std::unordered_map<uint32_t, OffsetVotes> votes_;
+    std::unordered_map<uint32_t, Active> active_;
+
+    // Contents whose votes changed since the last evaluation
+    std::unordered_set<uint32_t> touched_;
+    std::vector<index::Posting> postings_;
+
+    /**
+     * @brief Vote with one new sub-fingerprint's postings and slide the window
+     */
+    void advance(const index::Posting* postings, size_t count);
+
+    /**
+     * @brief Start or end matches of the touched contents
+     */
+    void evaluate(std::vector<MatchEvent>& events);
+
+    uint32_t votesAt(uint32_t content, int64_t offset) const;
+};
+
+} // namespace matcher
+} // namespace vfs
+
+#endif // STREAM_MATCHER_H
@@ -0,0 +1,166 @@
+#ifndef STREAM_MONITOR_H
+#define STREAM_MONITOR_H
+
+#include "matcher/stream_matcher.h"
+#include "monitoring/metrics.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+
+namespace vfs {
+namespace matcher {
+
+/**
+ * @brief Monitors many live channels on a fixed set of worker threads
+ *
+ * Each channel is a StreamMatcher session pinned to one worker when it is
+ * added, so its vote tables stay in that worker's caches. Fed
+ * sub-fingerprints are buffered; once per tick a worker takes the input
+ * of all its channels, looks every distinct hash up once in the shared
+ * index and advances each session from that one batch.
+ *
+ * Lag is how long fed input waits before its session has seen it.
+ */
+class StreamMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Called for every match event of a channel
+     *
+     * Events come on the channel's worker thread, except those flushed by
+     * removeChannel(), which come on the thread calling it. It must not
+     * add or remove channels.
+     */
+    using EventHandler = std::function<void(const std::string& channel,
+                                            const StreamMatcher::MatchEvent& event)>;
+
+    struct Config {
+        size_t num_workers;
+        uint64_t tick_ms;                // Input is batched over this period
+        StreamMatcher::Config session;
+
+        Config()
+            : num_workers(4)
+            , tick_ms(20) {}
+    };
+
+    struct ChannelStats {
+        std::string channel;
+        size_t worker;
+        uint64_t position;               // Sub-fingerprints matched so far
+        size_t pending_hashes;           // Fed, not yet matched
+        uint64_t lag_us;                 // Age of the oldest pending input, else of the last matched
+    };
+
+    StreamMonitor(
+        std::shared_ptr<database::DatabaseManager> db_manager,
+        std::shared_ptr<monitoring::MetricsCollector> metrics,
+        EventHandler handler,
+        const Config& config = Config());
+    ~StreamMonitor();
+
+    // Prevent copying
+    StreamMonitor(const StreamMonitor&) = delete;
+    StreamMonitor& operator=(const StreamMonitor&) = delete;
+
+    /**
+     * @brief Start monitoring a channel on the least loaded worker
+     * @return false if the channel already exists
+     */
+    bool addChannel(const std::string& channel);
+
+    /**
+     * @brief Stop monitoring a channel, ending its active matches
+     *
+     * Input fed but not yet matched is dropped. The channel cannot be
+     * added again until this returns.
+     */
+    bool removeChannel(const std::string& channel);
+
+    /**
+     * @brief Buffer a channel's new sub-fingerprints for the next tick
+     * @param captured When the audio was captured, for lag accounting
+     * @return false if the channel does not exist
+     */
+    bool feed(const std::string& channel,
+              std::vector<uint32_t> hashes,
+              Clock::time_point captured = Clock::now());
+
+    /**
+     * @brief Block until everything fed so far has been matched
+     */
+    void flush();
+
+    std::vector<ChannelStats> getChannelStats() const;
+    size_t numChannels() const;
+
+private:
+    struct Input {
+        std::vector<uint32_t> hashes;
+        Clock::time_point captured;
+    };
+
+    struct Channel {
+        std::string name;
+        std::unique_ptr<StreamMatcher> session;
+        // Guarded by the worker's mutex
+        std::deque<Input> pending;
+        size_t pending_hashes = 0;
+        uint64_t position = 0;
+        uint64_t last_lag_us = 0;
+    };
+
+    struct Worker {
+        // Guards the channel map and input queues; held only briefly
+        std::mutex mutex;
+        std::condition_variable wake_cv;
+        std::condition_variable done_cv;
+        std::unordered_map<std::string, std::shared_ptr<Channel>> channels;
+        uint64_t fed = 0;                // Inputs queued, ever
+        uint64_t matched = 0;            // Inputs matched or dropped, ever
+        bool flush_requested = false;
+
+        // Held for a whole tick; channel removal waits on it
+        std::mutex tick_mutex;
+        PostingBatch batch;
+        std::thread thread;
+    };
+
+    std::shared_ptr<database::DatabaseManager> db_manager_;
+    std::shared_ptr<monitoring::MetricsCollector> metrics_;
+    EventHandler handler_;
+    Config config_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> stop_{false};
+
+    struct Assignment {
+        size_t worker;
+        bool removing;                   // Being removed; the name stays taken
+    };
+
+    // Channel name -> worker it is pinned to
+    mutable std::mutex channels_mutex_;
+    std::unordered_map<std::string, Assignment> assignment_;
+    std::vector<size_t> load_;           // Channels per worker
+
+    void workerLoop(Worker& worker);
+
+    /**
+     * @brief Match all input queued for a worker's channels
+     */
+    void tick(Worker& worker);
+};
+
+} // namespace matcher
+} // namespace vfs
+
+#endif // STREAM_MONITOR_H
@@ -0,0 +1,92 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vfs {
+namespace monitoring {
+
+/**
+ * @brief Fixed-size log-linear latency histogram (HDR-style)
+ *
+ * Each power of two is split into 2^SUB_BUCKET_BITS linear buckets, so a
+ * recorded value is known to within about 3% whatever its magnitude, and
+ * memory never grows with the number of samples.
+ *
+ * Recording is lock-free: each thread counts into its own stripe of
+ * relaxed atomics, so concurrent recorders do not share cache lines.
+ * Readers merge the stripes; a snapshot taken during recording may miss
+ * samples recorded meanwhile but never sees a torn one.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 5;
+    static constexpr unsigned MAX_EXPONENT = 40;   // Larger values share the top bucket
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t NUM_BUCKETS =
+        SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    static constexpr size_t NUM_STRIPES = 16;
+
+    /**
+     * @brief Merged view of every stripe
+     */
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        std::vector<uint64_t> buckets;
+
+        double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+        /**
+         * @brief Value at a quantile in [0, 1], clamped to the observed range
+         */
+        double percentile(double quantile) const;
+    };
+
+    LatencyHistogram();
+
+    // Prevent copying
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t value);
+
+    Snapshot snapshot() const;
+
+    /**
+     * @brief Forget every sample (not atomic with concurrent recording)
+     */
+    void reset();
+
+    static size_t bucketFor(uint64_t value);
+    static uint64_t bucketLow(size_t bucket);
+    static uint64_t bucketHigh(size_t bucket);
+
+private:
+    // Stripes sit on their own cache lines so recorders do not false-share
+    struct alignas(64) Stripe {
+        std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets;
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> min{UINT64_MAX};
+        std::atomic<uint64_t> max{0};
+    };
+
+    std::vector<Stripe> stripes_;
+
+    /**
+     * @brief Stripe of the calling thread
+     */
+    Stripe& localStripe();
+};
+
+} // namespace monitoring
+} // namespace vfs
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,79 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace vfs {
+namespace utils {
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ *
+ * The mapping lives as long as the MappedFile object; share it through
+ * a shared_ptr to keep views into the data valid. Files can also be
+ * POSIX shared-memory objects, so processes mapping the same name share
+ * one physical copy of the data.
+ */
+class MappedFile {
+public:
+    ~MappedFile();
+
+    // Prevent copying
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Map a file read-only
+     * @return Mapping, or nullptr if the file cannot be opened or mapped
+     */
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    /**
+     * @brief Map a named POSIX shared-memory object read-only
+     * @param name Object name, e.g. "/vfs-index"
+     */
+    static std::shared_ptr<MappedFile> openShared(const std::string& name);
+
+    /**
+     * @brief Create a shared-memory object holding a copy of data
+     *
+     * Fails if the name already exists. The first 8 bytes are written
+     * last, so a reader that validates a leading magic number never
+     * accepts a partially written object.
+     */
+    static bool createShared(const std::string& name, const void* data, size_t size);
+
+    /**
+     * @brief Remove a shared-memory name; existing mappings stay valid
+     */
+    static bool unlinkShared(const std::string& name);
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Hint that the mapped pages will be needed soon
+     */
+    void adviseWillNeed() const;
+
+    /**
+     * @brief Hint that the mapped pages can be dropped from memory
+     */
+    void adviseDontNeed() const;
+
+private:
+    static std::shared_ptr<MappedFile> map(int fd);
+
+    MappedFile(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    const uint8_t* data_;
+    size_t size_;
+};
+
+} // namespace utils
+} // namespace vfs
+
+#endif // MAPPED_FILE_H
@@ -1,4 +1,5 @@
 #include "core/fingerprint_generator.h"
+#include "core/hamming.h"
 #include <cmath>
 #include <algorithm>
 #include <sstream>
@@ -167,16 +168,9 @@ double FingerprintGenerator::calculateSimilarity(
 
     // Use Hamming distance for hash comparison
     size_t min_length = std::min(fp1.hash_values.size(), fp2.hash_values.size());
-    size_t matching_bits = 0;
-    size_t total_bits = 0;
-
-    for (size_t i = 0; i < min_length; ++i) {
-        uint32_t xor_result = fp1.hash_values[i] ^ fp2.hash_values[i];
-        
-        // Count matching bits (inverted popcount)
-        matching_bits += 32 - __builtin_popcount(xor_result);
-        total_bits += 32;
-    }
+    uint64_t total_bits = static_cast<uint64_t>(min_length) * 32;
+    uint64_t matching_bits = total_bits - hammingDistance(
+        fp1.hash_values.data(), fp2.hash_values.data(), min_length);
 
     return static_cast<double>(matching_bits) / total_bits;
 }
@@ -0,0 +1,59 @@
+#include "core/hamming.h"
+#include <cstring>
+#include <algorithm>
+
+namespace vfs {
+namespace core {
+
+uint64_t hammingDistance(const void* a, const void* b, size_t num_words) {
+    const unsigned char* pa = static_cast<const unsigned char*>(a);
+    const unsigned char* pb = static_cast<const unsigned char*>(b);
+
+    uint64_t distance = 0;
+    size_t i = 0;
+
+    // Two sub-fingerprints per 64-bit popcount; memcpy compiles to plain
+    // unaligned loads
+    for (; i + 2 <= num_words; i += 2) {
+        uint64_t wa;
+        uint64_t wb;
+        std::memcpy(&wa, pa + i * sizeof(uint32_t), sizeof(wa));
+        std::memcpy(&wb, pb + i * sizeof(uint32_t), sizeof(wb));
+        distance += __builtin_popcountll(wa ^ wb);
+    }
+
+    if (i < num_words) {
+        uint32_t wa;
+        uint32_t wb;
+        std::memcpy(&wa, pa + i * sizeof(uint32_t), sizeof(wa));
+        std::memcpy(&wb, pb + i * sizeof(uint32_t), sizeof(wb));
+        distance += __builtin_popcount(wa ^ wb);
+    }
+
+    return distance;
+}
+
+uint64_t alignedMatchingBits(
+    const void* query, size_t query_words,
+    const void* stored, size_t stored_words,
+    int64_t offset) {
+
+    // Overlap in query coordinates: i in [first, last) with i + offset valid
+    int64_t first = std::max<int64_t>(0, -offset);
+    int64_t last = std::min<int64_t>(
+        static_cast<int64_t>(query_words),
+        static_cast<int64_t>(stored_words) - offset);
+
+    if (first >= last) {
+        return 0;
+    }
+
+    size_t overlap = static_cast<size_t>(last - first);
+    const unsigned char* q = static_cast<const unsigned char*>(query) + first * sizeof(uint32_t);
+    const unsigned char* s = static_cast<const unsigned char*>(stored) + (first + offset) * sizeof(uint32_t);
+
+    return overlap * 32 - hammingDistance(q, s, overlap);
+}
+
+} // namespace core
+} // namespace vfs
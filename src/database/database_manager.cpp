@@ -1,19 +1,85 @@
 #include "database/database_manager.h"
+#include "database/sql_functions.h"
+#include "database/index_vtab.h"
+#include "core/hamming.h"
 #include <iostream>
 #include <sstream>
 #include <optional>
+#include <future>
+#include <unordered_map>
 #include <map>
 #include <algorithm>
+#include <cstdlib>
 
 namespace vfs {
 namespace database {
 
-DatabaseManager::DatabaseManager(const std::string& db_path)
+namespace {
+
+using OffsetVotes = DatabaseManager::OffsetVotes;
+
+// Hash lookups between deadline checks; reading the clock per hash costs
+// more than the lookups it would save
+constexpr size_t DEADLINE_CHECK_INTERVAL = 64;
+
+// Fingerprint rows read per database lock while building a segment offline
+constexpr size_t POSTING_READ_CHUNK = 65536;
+
+bool pastDeadline(DatabaseManager::Deadline deadline) {
+    return deadline != DatabaseManager::Deadline::max() &&
+           std::chrono::steady_clock::now() >= deadline;
+}
+
+/**
+ * @brief Pick the most voted offset (ties go to the smaller offset)
+ */
+void bestOffset(const OffsetVotes& votes, int32_t& offset, uint32_t& count) {
+    offset = 0;
+    count = 0;
+    for (const auto& [candidate_offset, candidate_count] : votes) {
+        if (candidate_count > count ||
+            (candidate_count == count && candidate_offset < offset)) {
+            offset = candidate_offset;
+            count = candidate_count;
+        }
+    }
+}
+
+/**
+ * @brief Decode a raw_hash written as hex text, as rows were before it became a BLOB
+ */
+void decodeHexHash(const char* hex, size_t length, std::vector<uint32_t>& out) {
+    out.clear();
+    for (size_t pos = 0; pos + 8 <= length; pos += 8) {
+        out.push_back(static_cast<uint32_t>(
+            std::strtoul(std::string(hex + pos, 8).c_str(), nullptr, 16)));
+    }
+}
+
+} // namespace
+
+DatabaseManager::DatabaseManager(const std::string& db_path, const Config& config)
     : db_path_(db_path)
+    , config_(config)
     , db_(nullptr)
     , insert_content_stmt_(nullptr)
     , insert_fingerprint_stmt_(nullptr)
-    , query_fingerprints_stmt_(nullptr) {
+    , clear_query_stmt_(nullptr)
+    , insert_query_hash_stmt_(nullptr)
+    , vote_candidates_stmt_(nullptr)
+    , content_rowid_stmt_(nullptr)
+    , content_by_rowid_stmt_(nullptr)
+    , insert_metadata_stmt_(nullptr)
+    , hash_filter_capacity_(0)
+    , hash_filter_inserts_(0) {
+
+    // Parallel re-ranking steps statements of one connection from several
+    // threads. That needs the connection in serialized mode: the library
+    // must be built thread-safe, and initialize() opens with FULLMUTEX so
+    // a multi-thread (mode 2) build still serializes this connection.
+    if (config_.scoring_threads > 1 && sqlite3_threadsafe() != 0) {
+        scoring_pool_ = std::make_unique<utils::ThreadPool>(config_.scoring_threads - 1);
+    }
 }
 
 DatabaseManager::~DatabaseManager() {
@@ -27,16 +93,32 @@ bool DatabaseManager::initialize() {
     std::lock_guard<std::mutex> lock(db_mutex_);
 
     // Open database
-    int rc = sqlite3_open(db_path_.c_str(), &db_);
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (scoring_pool_) {
+        flags |= SQLITE_OPEN_FULLMUTEX;
+    }
+    int rc = sqlite3_open_v2(db_path_.c_str(), &db_, flags, nullptr);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to open database: " << sqlite3_errmsg(db_) << std::endl;
         return false;
     }
 
+    // Without a connection mutex (e.g. SQLITE_CONFIG_SINGLETHREAD) scoring stays serial
+    if (scoring_pool_ && !sqlite3_db_mutex(db_)) {
+        scoring_pool_.reset();
+    }
+
     // Enable WAL mode for better concurrency
     executeSql("PRAGMA journal_mode=WAL");
     executeSql("PRAGMA synchronous=NORMAL");
     executeSql("PRAGMA cache_size=-64000"); // 64MB cache
+    executeSql("PRAGMA temp_store=MEMORY");
+
+    // Native scoring functions used by the match query
+    if (!registerSqlFunctions(db_)) {
+        std::cerr << "Failed to register SQL functions: " << sqlite3_errmsg(db_) << std::endl;
+        return false;
+    }
 
     // Create schema
     const char* schema = R"(
@@ -64,10 +146,15 @@ bool DatabaseManager::initialize() {
         
         CREATE TABLE IF NOT EXISTS fingerprint_metadata (
             content_id TEXT PRIMARY KEY,
-            raw_hash TEXT NOT NULL,
+            raw_hash BLOB NOT NULL,
             num_hashes INTEGER NOT NULL,
             FOREIGN KEY (content_id) REFERENCES content(content_id)
         );
+
+        CREATE TEMP TABLE IF NOT EXISTS query_hashes (
+            position INTEGER NOT NULL,
+            hash_value INTEGER NOT NULL
+        );
     )";
 
     if (!executeSql(schema)) {
@@ -75,7 +162,12 @@ bool DatabaseManager::initialize() {
     }
 
     // Prepare statements
-    return prepareStatements();
+    if (!prepareStatements()) {
+        return false;
+    }
+
+    rebuildHashFilter();
+    return true;
 }
 
 bool DatabaseManager::executeSql(const std::string& sql) {
@@ -102,33 +194,316 @@ bool DatabaseManager::prepareStatements() {
         VALUES (?, ?, ?)
     )";
 
-    const char* query_fingerprints_sql = R"(
-        SELECT DISTINCT c.id, c.content_id, c.title, c.source, c.duration_ms, c.created_at,
-               COUNT(*) as match_count
-        FROM fingerprints f
-        JOIN content c ON f.content_id = c.content_id
-        WHERE f.hash_value = ?
-        GROUP BY c.content_id
-        ORDER BY match_count DESC
+    // Candidates are voted inside SQLite: one statement joins all query
+    // hashes against the hash index and aggregates offsets per content
+    const char* vote_candidates_sql = R"(
+        SELECT f.content_id,
+               offset_vote(f.position - q.position) AS votes,
+               best_offset(f.position - q.position) AS offset
+        FROM temp.query_hashes q
+        CROSS JOIN fingerprints f ON f.hash_value = q.hash_value
+        GROUP BY f.content_id
+        ORDER BY votes DESC
         LIMIT ?
     )";
 
+    const char* clear_query_sql = "DELETE FROM temp.query_hashes";
+    const char* insert_query_hash_sql =
+        "INSERT INTO temp.query_hashes (position, hash_value) VALUES (?, ?)";
+
+    const char* insert_metadata_sql = R"(
+        INSERT OR REPLACE INTO fingerprint_metadata (content_id, raw_hash, num_hashes)
+        VALUES (?, ?, ?)
+    )";
+
+    const char* raw_hash_sql = "SELECT raw_hash FROM fingerprint_metadata WHERE content_id = ?";
+
+    const char* content_rowid_sql = "SELECT id FROM content WHERE content_id = ?";
+    const char* content_by_rowid_sql = "SELECT content_id FROM content WHERE id = ?";
+
     int rc = sqlite3_prepare_v2(db_, insert_content_sql, -1, &insert_content_stmt_, nullptr);
     if (rc != SQLITE_OK) return false;
 
     rc = sqlite3_prepare_v2(db_, insert_fingerprint_sql, -1, &insert_fingerprint_stmt_, nullptr);
     if (rc != SQLITE_OK) return false;
 
-    rc = sqlite3_prepare_v2(db_, query_fingerprints_sql, -1, &query_fingerprints_stmt_, nullptr);
+    rc = sqlite3_prepare_v2(db_, clear_query_sql, -1, &clear_query_stmt_, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_prepare_v2(db_, insert_query_hash_sql, -1, &insert_query_hash_stmt_, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_prepare_v2(db_, vote_candidates_sql, -1, &vote_candidates_stmt_, nullptr);
     if (rc != SQLITE_OK) return false;
 
+    rc = sqlite3_prepare_v2(db_, content_rowid_sql, -1, &content_rowid_stmt_, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_prepare_v2(db_, content_by_rowid_sql, -1, &content_by_rowid_stmt_, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_prepare_v2(db_, insert_metadata_sql, -1, &insert_metadata_stmt_, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    size_t num_raw_hash_stmts = scoring_pool_ ? config_.scoring_threads : 1;
+    raw_hash_stmts_.assign(num_raw_hash_stmts, nullptr);
+    for (auto& stmt : raw_hash_stmts_) {
+        rc = sqlite3_prepare_v2(db_, raw_hash_sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) return false;
+    }
+
     return true;
 }
 
 void DatabaseManager::cleanupStatements() {
     if (insert_content_stmt_) sqlite3_finalize(insert_content_stmt_);
     if (insert_fingerprint_stmt_) sqlite3_finalize(insert_fingerprint_stmt_);
-    if (query_fingerprints_stmt_) sqlite3_finalize(query_fingerprints_stmt_);
+    if (clear_query_stmt_) sqlite3_finalize(clear_query_stmt_);
+    if (insert_query_hash_stmt_) sqlite3_finalize(insert_query_hash_stmt_);
+    if (vote_candidates_stmt_) sqlite3_finalize(vote_candidates_stmt_);
+    if (content_rowid_stmt_) sqlite3_finalize(content_rowid_stmt_);
+    if (content_by_rowid_stmt_) sqlite3_finalize(content_by_rowid_stmt_);
+    if (insert_metadata_stmt_) sqlite3_finalize(insert_metadata_stmt_);
+    for (auto* stmt : raw_hash_stmts_) {
+        if (stmt) sqlite3_finalize(stmt);
+    }
+}
+
+std::optional<int64_t> DatabaseManager::getContentRowId(const std::string& content_id) {
+    sqlite3_reset(content_rowid_stmt_);
+    sqlite3_bind_text(content_rowid_stmt_, 1, content_id.c_str(), -1, SQLITE_TRANSIENT);
+
+    if (sqlite3_step(content_rowid_stmt_) == SQLITE_ROW) {
+        return sqlite3_column_int64(content_rowid_stmt_, 0);
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> DatabaseManager::getContentIdByRowId(int64_t rowid) {
+    sqlite3_reset(content_by_rowid_stmt_);
+    sqlite3_bind_int64(content_by_rowid_stmt_, 1, rowid);
+
+    if (sqlite3_step(content_by_rowid_stmt_) == SQLITE_ROW) {
+        return std::string(reinterpret_cast<const char*>(
+            sqlite3_column_text(content_by_rowid_stmt_, 0)));
+    }
+    return std::nullopt;
+}
+
+std::optional<std::string> DatabaseManager::getContentIdForPosting(uint32_t content) {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    return getContentIdByRowId(content);
+}
+
+void DatabaseManager::rebuildHashFilter() {
+    if (config_.hash_filter_fpr <= 0.0) {
+        return;
+    }
+
+    // DISTINCT is answered from idx_hash without touching the table
+    std::vector<uint32_t> hashes;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT DISTINCT hash_value FROM fingerprints",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        hash_filter_ = index::BloomFilter();
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        hashes.push_back(static_cast<uint32_t>(sqlite3_column_int(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+
+    // Leave headroom so inserts do not trigger a rebuild right away
+    hash_filter_capacity_ = std::max<size_t>(2 * hashes.size(), 1 << 16);
+    hash_filter_inserts_ = hashes.size();
+    hash_filter_ = index::BloomFilter(hash_filter_capacity_, config_.hash_filter_fpr);
+    for (uint32_t hash : hashes) {
+        hash_filter_.add(hash);
+    }
+}
+
+bool DatabaseManager::collectPostings(index::IndexBuilder& builder) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT COUNT(*) FROM fingerprints", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            builder.reserve(builder.size() + static_cast<size_t>(sqlite3_column_int64(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    const char* scan_sql = R"(
+        SELECT f.hash_value, c.id, f.position
+        FROM fingerprints f
+        JOIN content c ON f.content_id = c.content_id
+    )";
+
+    int rc = sqlite3_prepare_v2(db_, scan_sql, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return false;
+    }
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        builder.add(
+            static_cast<uint32_t>(sqlite3_column_int(stmt, 0)),
+            static_cast<uint32_t>(sqlite3_column_int64(stmt, 1)),
+            static_cast<uint32_t>(sqlite3_column_int(stmt, 2)));
+    }
+    sqlite3_finalize(stmt);
+
+    return rc == SQLITE_DONE;
+}
+
+bool DatabaseManager::readPostingChunk(
+    int64_t after_id,
+    size_t limit,
+    std::vector<index::PostingEntry>& out,
+    int64_t& last_id) {
+
+    const char* chunk_sql = R"(
+        SELECT f.id, f.hash_value, c.id, f.position
+        FROM fingerprints f
+        LEFT JOIN content c ON f.content_id = c.content_id
+        WHERE f.id > ?
+        ORDER BY f.id
+        LIMIT ?
+    )";
+
+    sqlite3_stmt* stmt;
+    int rc = sqlite3_prepare_v2(db_, chunk_sql, -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, after_id);
+    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(limit));
+
+    // Rows without content are skipped, but still advance last_id
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        last_id = sqlite3_column_int64(stmt, 0);
+        if (sqlite3_column_type(stmt, 2) == SQLITE_NULL) {
+            continue;
+        }
+        out.push_back({
+            static_cast<uint32_t>(sqlite3_column_int(stmt, 1)),
+            static_cast<uint32_t>(sqlite3_column_int64(stmt, 2)),
+            static_cast<uint32_t>(sqlite3_column_int(stmt, 3))});
+    }
+    sqlite3_finalize(stmt);
+
+    return rc == SQLITE_DONE;
+}
+
+bool DatabaseManager::buildIndexSegment(
+    const std::string& path,
+    const index::IndexBuilder::Config& config) {
+
+    index::IndexBuilder builder(config);
+    std::vector<index::PostingEntry> chunk;
+    chunk.reserve(POSTING_READ_CHUNK);
+
+    // Rows are read in id order, one bounded chunk per lock; the builder
+    // adds, sorts and spills them with the lock released
+    int64_t last_id = 0;
+    while (true) {
+        int64_t after_id = last_id;
+        chunk.clear();
+        {
+            std::lock_guard<std::mutex> lock(db_mutex_);
+            if (!readPostingChunk(after_id, POSTING_READ_CHUNK, chunk, last_id)) {
+                return false;
+            }
+        }
+        if (last_id == after_id) {
+            break;
+        }
+
+        for (const auto& entry : chunk) {
+            builder.add(entry.hash, entry.content, entry.position);
+        }
+    }
+
+    return builder.buildFile(path);
+}
+
+bool DatabaseManager::buildFingerprintFile(const std::string& path) {
+    std::map<uint32_t, std::vector<uint32_t>> fingerprints;
+
+    {
+        std::lock_guard<std::mutex> lock(db_mutex_);
+
+        const char* scan_sql = R"(
+            SELECT c.id, m.raw_hash
+            FROM fingerprint_metadata m
+            JOIN content c ON m.content_id = c.content_id
+        )";
+
+        sqlite3_stmt* stmt;
+        int rc = sqlite3_prepare_v2(db_, scan_sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            return false;
+        }
+
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            auto& hashes = fingerprints[static_cast<uint32_t>(sqlite3_column_int64(stmt, 0))];
+            if (sqlite3_column_type(stmt, 1) == SQLITE_BLOB) {
+                const auto* data = static_cast<const uint32_t*>(sqlite3_column_blob(stmt, 1));
+                size_t words = static_cast<size_t>(sqlite3_column_bytes(stmt, 1)) / sizeof(uint32_t);
+                hashes.assign(data, data + words);
+            } else {
+                decodeHexHash(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                              static_cast<size_t>(sqlite3_column_bytes(stmt, 1)), hashes);
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        if (rc != SQLITE_DONE) {
+            return false;
+        }
+    }
+
+    // Written without the database lock
+    return index::TieredStore::writeFingerprintFile(path, fingerprints);
+}
+
+bool DatabaseManager::attachTieredStore(std::shared_ptr<index::TieredStore> store) {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+
+    if (tiered_store_) {
+        retired_tiered_stores_.push_back(std::move(tiered_store_));
+    }
+    tiered_store_ = std::move(store);
+    tiered_store_ptr_.store(tiered_store_.get(), std::memory_order_release);
+    generation_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool DatabaseManager::attachIndex(std::shared_ptr<index::SegmentedIndex> index, bool backfill) {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+
+    // Backfill postings already stored in SQLite as one bulk-built segment
+    if (backfill) {
+        index::IndexBuilder builder;
+        if (!collectPostings(builder)) {
+            return false;
+        }
+        if (builder.size() > 0) {
+            index->addSegment(builder.build());
+        }
+    }
+
+    // Expose the index to SQL as temp.postings for operational queries
+    executeSql("DROP TABLE IF EXISTS temp.postings");
+    if (!registerIndexModule(db_, index) ||
+        !executeSql("CREATE VIRTUAL TABLE temp.postings USING vfs_index")) {
+        std::cerr << "Failed to expose posting index to SQL" << std::endl;
+    }
+
+    if (index_) {
+        retired_indexes_.push_back(std::move(index_));
+    }
+    index_ = std::move(index);
+    index_ptr_.store(index_.get(), std::memory_order_release);
+    generation_.fetch_add(1, std::memory_order_release);
+    return true;
 }
 
 bool DatabaseManager::storeFingerprint(
@@ -155,6 +530,11 @@ bool DatabaseManager::storeFingerprint(
         return false;
     }
 
+    std::optional<int64_t> rowid;
+    if (index_) {
+        rowid = getContentRowId(content_id);
+    }
+
     // Insert fingerprint hashes
     for (size_t i = 0; i < fingerprint.hash_values.size(); ++i) {
         sqlite3_reset(insert_fingerprint_stmt_);
@@ -169,83 +549,274 @@ bool DatabaseManager::storeFingerprint(
         }
     }
 
-    // Insert raw hash metadata
-    std::stringstream ss;
-    ss << "INSERT OR REPLACE INTO fingerprint_metadata (content_id, raw_hash, num_hashes) "
-       << "VALUES ('" << content_id << "', '" << fingerprint.raw_hash << "', "
-       << fingerprint.hash_values.size() << ")";
-    
-    if (!executeSql(ss.str())) {
+    // Insert raw hash metadata as a native-order BLOB of sub-fingerprints
+    sqlite3_reset(insert_metadata_stmt_);
+    sqlite3_bind_text(insert_metadata_stmt_, 1, content_id.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_blob(insert_metadata_stmt_, 2, fingerprint.hash_values.data(),
+                      static_cast<int>(fingerprint.hash_values.size() * sizeof(uint32_t)),
+                      SQLITE_TRANSIENT);
+    sqlite3_bind_int64(insert_metadata_stmt_, 3,
+                       static_cast<int64_t>(fingerprint.hash_values.size()));
+
+    if (sqlite3_step(insert_metadata_stmt_) != SQLITE_DONE) {
         executeSql("ROLLBACK");
         return false;
     }
 
     executeSql("COMMIT");
+
+    if (!hash_filter_.empty()) {
+        for (uint32_t hash : fingerprint.hash_values) {
+            hash_filter_.add(hash);
+        }
+        // Counting every insert overestimates distinct hashes; that only
+        // makes the rebuild come early
+        hash_filter_inserts_ += fingerprint.hash_values.size();
+        if (hash_filter_inserts_ > hash_filter_capacity_) {
+            rebuildHashFilter();
+        }
+    }
+
+    if (index_ && rowid) {
+        index_->addFingerprint(static_cast<uint32_t>(*rowid), fingerprint.hash_values);
+    }
+
+    // Bumped once the new postings are visible to findMatches
+    generation_.fetch_add(1, std::memory_order_release);
     return true;
 }
 
 std::vector<DatabaseManager::MatchResult> DatabaseManager::findMatches(
     const core::FingerprintGenerator::Fingerprint& fingerprint,
     double min_similarity,
-    size_t max_results) {
+    size_t max_results,
+    Deadline deadline,
+    bool* partial) {
     
+    const auto& hashes = fingerprint.hash_values;
+
+    // Vote from the in-memory index before taking the database lock
+    if (hasIndex()) {
+        VoteTable votes;
+        bool complete = voteRange(hashes, 0, hashes.size(), votes, deadline);
+        auto results = rankVotes(fingerprint, votes, min_similarity, max_results, deadline, partial);
+        if (partial && !complete) {
+            *partial = true;
+        }
+        return results;
+    }
+
     std::lock_guard<std::mutex> lock(db_mutex_);
-    std::vector<MatchResult> results;
+    bool out_of_time = false;
 
-    // Collect candidate content IDs
-    std::map<std::string, uint32_t> candidate_matches;
+    // Collect candidates with their best time offset
+    std::vector<Candidate> candidates;
 
-    for (uint32_t hash : fingerprint.hash_values) {
-        sqlite3_reset(query_fingerprints_stmt_);
-        sqlite3_bind_int(query_fingerprints_stmt_, 1, hash);
-        sqlite3_bind_int(query_fingerprints_stmt_, 2, static_cast<int>(max_results * 2));
+    executeSql("BEGIN");
 
-        while (sqlite3_step(query_fingerprints_stmt_) == SQLITE_ROW) {
-            std::string content_id = reinterpret_cast<const char*>(
-                sqlite3_column_text(query_fingerprints_stmt_, 1));
-            uint32_t match_count = sqlite3_column_int(query_fingerprints_stmt_, 6);
-            
-            candidate_matches[content_id] += match_count;
+    sqlite3_reset(clear_query_stmt_);
+    sqlite3_step(clear_query_stmt_);
+
+    // Past the deadline, vote with the hashes inserted so far
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (i % DEADLINE_CHECK_INTERVAL == 0 && pastDeadline(deadline)) {
+            out_of_time = true;
+            break;
+        }
+        // Most hashes of a noisy capture match nothing stored
+        if (!hash_filter_.mayContain(hashes[i])) {
+            continue;
         }
+        sqlite3_reset(insert_query_hash_stmt_);
+        sqlite3_bind_int(insert_query_hash_stmt_, 1, static_cast<int>(i));
+        sqlite3_bind_int(insert_query_hash_stmt_, 2, hashes[i]);
+        sqlite3_step(insert_query_hash_stmt_);
     }
 
-    // Calculate similarity scores for candidates
-    for (const auto& [content_id, match_count] : candidate_matches) {
-        // Retrieve stored fingerprint
-        std::stringstream ss;
-        ss << "SELECT raw_hash FROM fingerprint_metadata WHERE content_id = '" 
-           << content_id << "'";
+    sqlite3_reset(vote_candidates_stmt_);
+    sqlite3_bind_int64(vote_candidates_stmt_, 1,
+                       static_cast<int64_t>(std::max(config_.max_candidates, max_results)));
+
+    while (sqlite3_step(vote_candidates_stmt_) == SQLITE_ROW) {
+        Candidate candidate;
+        candidate.content_id = reinterpret_cast<const char*>(
+            sqlite3_column_text(vote_candidates_stmt_, 0));
+        candidate.votes = static_cast<uint32_t>(sqlite3_column_int64(vote_candidates_stmt_, 1));
+        candidate.offset = static_cast<int32_t>(sqlite3_column_int64(vote_candidates_stmt_, 2));
+        candidate.similarity = 0.0;
+        candidate.scored = false;
+        candidate.rowid = -1;
+        candidates.push_back(candidate);
+    }
+    sqlite3_reset(vote_candidates_stmt_);
 
-        sqlite3_stmt* stmt;
-        int rc = sqlite3_prepare_v2(db_, ss.str().c_str(), -1, &stmt, nullptr);
-        
-        if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
-            std::string stored_hash = reinterpret_cast<const char*>(
-                sqlite3_column_text(stmt, 0));
-
-            // Simple similarity based on matching hash count
-            double similarity = static_cast<double>(match_count) / 
-                              std::max(fingerprint.hash_values.size(), 
-                                     stored_hash.length() / 8);
-
-            if (similarity >= min_similarity) {
-                auto metadata = getContentById(content_id);
-                if (metadata) {
-                    MatchResult result;
-                    result.metadata = *metadata;
-                    result.similarity_score = similarity;
-                    result.matched_segments = match_count;
-                    results.push_back(result);
-                }
-            }
+    executeSql("COMMIT");
+
+    return rankCandidates(fingerprint, candidates, min_similarity, max_results,
+                          deadline, out_of_time, partial);
+}
+
+bool DatabaseManager::voteRange(
+    const std::vector<uint32_t>& hashes,
+    size_t begin,
+    size_t end,
+    VoteTable& votes,
+    Deadline deadline) const {
+
+    const index::SegmentedIndex* index = index_ptr_.load(std::memory_order_acquire);
+    index::TieredStore* store = tiered_store_ptr_.load(std::memory_order_acquire);
+    if (!index && !store) {
+        return true;
+    }
+
+    std::vector<index::Posting> postings;
+    for (size_t i = begin; i < end; ++i) {
+        if ((i - begin) % DEADLINE_CHECK_INTERVAL == 0 && pastDeadline(deadline)) {
+            return false;
+        }
+        postings.clear();
+        if (index) {
+            index->lookup(hashes[i], postings);
+        }
+        if (store) {
+            store->lookup(hashes[i], postings);
+        }
+        size_t limit = std::min(postings.size(), config_.max_postings_per_hash);
+        for (size_t p = 0; p < limit; ++p) {
+            int32_t offset = static_cast<int32_t>(postings[p].position) - static_cast<int32_t>(i);
+            ++votes[postings[p].content][offset];
+        }
+    }
+    return true;
+}
+
+size_t DatabaseManager::lookupPostings(uint32_t hash, std::vector<index::Posting>& out) const {
+    out.clear();
+    const index::SegmentedIndex* index = index_ptr_.load(std::memory_order_acquire);
+    index::TieredStore* store = tiered_store_ptr_.load(std::memory_order_acquire);
+    if (index) {
+        index->lookup(hash, out);
+    }
+    if (store) {
+        store->lookup(hash, out);
+    }
+    return std::min(out.size(), config_.max_postings_per_hash);
+}
+
+void DatabaseManager::mergeVotes(VoteTable& into, const VoteTable& from) {
+    for (const auto& [content, offsets] : from) {
+        OffsetVotes& target = into[content];
+        for (const auto& [offset, count] : offsets) {
+            target[offset] += count;
+        }
+    }
+}
+
+std::vector<DatabaseManager::MatchResult> DatabaseManager::rankVotes(
+    const core::FingerprintGenerator::Fingerprint& fingerprint,
+    const VoteTable& votes,
+    double min_similarity,
+    size_t max_results,
+    Deadline deadline,
+    bool* partial) {
+
+    // Best time offset per content, then only the strongest few are
+    // resolved to content IDs under the database lock
+    struct Voted {
+        uint32_t rowid;
+        int32_t offset;
+        uint32_t votes;
+    };
+    std::vector<Voted> voted;
+    voted.reserve(votes.size());
+
+    for (const auto& [rowid, offsets] : votes) {
+        Voted entry = {rowid, 0, 0};
+        bestOffset(offsets, entry.offset, entry.votes);
+        voted.push_back(entry);
+    }
+
+    size_t candidate_limit = std::max(config_.max_candidates, max_results);
+    if (voted.size() > candidate_limit) {
+        std::nth_element(voted.begin(), voted.begin() + candidate_limit, voted.end(),
+            [](const Voted& a, const Voted& b) {
+                return a.votes > b.votes;
+            });
+        voted.resize(candidate_limit);
+    }
+
+    std::lock_guard<std::mutex> lock(db_mutex_);
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(voted.size());
+    for (const auto& entry : voted) {
+        auto content_id = getContentIdByRowId(entry.rowid);
+        if (content_id) {
+            candidates.push_back({*content_id, entry.offset, entry.votes, 0.0, false,
+                                  static_cast<int64_t>(entry.rowid)});
         }
-        
-        sqlite3_finalize(stmt);
     }
 
-    // Sort by similarity score
+    return rankCandidates(fingerprint, candidates, min_similarity, max_results,
+                          deadline, false, partial);
+}
+
+std::vector<DatabaseManager::MatchResult> DatabaseManager::rankCandidates(
+    const core::FingerprintGenerator::Fingerprint& fingerprint,
+    std::vector<Candidate>& candidates,
+    double min_similarity,
+    size_t max_results,
+    Deadline deadline,
+    bool out_of_time,
+    bool* partial) {
+
+    std::vector<MatchResult> results;
+
+    // Only the strongest candidates are worth a bitwise comparison
+    size_t candidate_limit = std::max(config_.max_candidates, max_results);
+    if (candidates.size() > candidate_limit) {
+        std::nth_element(candidates.begin(), candidates.begin() + candidate_limit, candidates.end(),
+            [](const Candidate& a, const Candidate& b) {
+                return a.votes > b.votes;
+            });
+        candidates.resize(candidate_limit);
+    }
+
+    // Most voted first, so a deadline cuts off the weakest candidates
+    std::sort(candidates.begin(), candidates.end(),
+        [](const Candidate& a, const Candidate& b) {
+            return a.votes > b.votes;
+        });
+
+    scoreCandidates(fingerprint, candidates, deadline);
+
+    size_t query_size = std::max<size_t>(fingerprint.hash_values.size(), 1);
+    for (const auto& candidate : candidates) {
+        out_of_time = out_of_time || !candidate.scored;
+        if (candidate.scored && candidate.similarity < min_similarity) {
+            continue;
+        }
+
+        auto metadata = getContentById(candidate.content_id);
+        if (metadata) {
+            MatchResult result;
+            result.metadata = *metadata;
+            result.matched_segments = candidate.votes;
+            result.scored = candidate.scored;
+            // Cut short: the vote count is the best evidence there is
+            result.similarity_score = candidate.scored
+                ? candidate.similarity
+                : static_cast<double>(candidate.votes) / query_size;
+            results.push_back(result);
+        }
+    }
+
+    // Scored results first, each group by score
     std::sort(results.begin(), results.end(),
         [](const MatchResult& a, const MatchResult& b) {
+            if (a.scored != b.scored) {
+                return a.scored;
+            }
             return a.similarity_score > b.similarity_score;
         });
 
@@ -253,9 +824,105 @@ std::vector<DatabaseManager::MatchResult> DatabaseManager::findMatches(
         results.resize(max_results);
     }
 
+    if (partial) {
+        *partial = out_of_time;
+    }
     return results;
 }
 
+void DatabaseManager::scoreCandidates(
+    const core::FingerprintGenerator::Fingerprint& fingerprint,
+    std::vector<Candidate>& candidates,
+    Deadline deadline) {
+
+    size_t workers = 1;
+    if (scoring_pool_ && candidates.size() >= config_.min_parallel_candidates) {
+        workers = raw_hash_stmts_.size();
+    }
+
+    // Each worker scores a strided share of the candidates with its own statement
+    std::vector<std::future<void>> futures;
+    for (size_t w = 1; w < workers; ++w) {
+        futures.push_back(scoring_pool_->submit([this, &fingerprint, &candidates, w, workers, deadline]() {
+            scoreCandidateRange(fingerprint, candidates, w, workers, raw_hash_stmts_[w], deadline);
+        }));
+    }
+
+    scoreCandidateRange(fingerprint, candidates, 0, workers, raw_hash_stmts_[0], deadline);
+
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+void DatabaseManager::scoreCandidateRange(
+    const core::FingerprintGenerator::Fingerprint& fingerprint,
+    std::vector<Candidate>& candidates,
+    size_t first,
+    size_t stride,
+    sqlite3_stmt* stmt,
+    Deadline deadline) {
+
+    const auto& query = fingerprint.hash_values;
+    std::vector<uint32_t> legacy_hash;
+    index::TieredStore* store = tiered_store_ptr_.load(std::memory_order_acquire);
+
+    for (size_t i = first; i < candidates.size(); i += stride) {
+        // Leave the rest unscored once out of time; the most-voted
+        // candidate is scored regardless, so a partial answer has one
+        if (i > 0 && pastDeadline(deadline)) {
+            break;
+        }
+
+        Candidate& candidate = candidates[i];
+        candidate.similarity = 0.0;
+        candidate.scored = true;
+
+        if (query.empty()) {
+            continue;
+        }
+
+        // A tiered store serves the fingerprint without touching SQLite
+        if (store && candidate.rowid >= 0) {
+            index::TieredStore::FingerprintView view =
+                store->getFingerprint(static_cast<uint32_t>(candidate.rowid));
+            if (!view.empty()) {
+                uint64_t matching_bits = core::alignedMatchingBits(
+                    query.data(), query.size(), view.data, view.size, candidate.offset);
+                candidate.similarity = static_cast<double>(matching_bits) / (32.0 * query.size());
+                continue;
+            }
+        }
+
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, candidate.content_id.c_str(), -1, SQLITE_STATIC);
+
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            continue;
+        }
+
+        const void* stored;
+        size_t stored_words;
+
+        if (sqlite3_column_type(stmt, 0) == SQLITE_BLOB) {
+            // Zero-copy: the pointer is valid until the statement moves on
+            stored = sqlite3_column_blob(stmt, 0);
+            stored_words = static_cast<size_t>(sqlite3_column_bytes(stmt, 0)) / sizeof(uint32_t);
+        } else {
+            decodeHexHash(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                          static_cast<size_t>(sqlite3_column_bytes(stmt, 0)), legacy_hash);
+            stored = legacy_hash.data();
+            stored_words = legacy_hash.size();
+        }
+
+        uint64_t matching_bits = core::alignedMatchingBits(
+            query.data(), query.size(), stored, stored_words, candidate.offset);
+        candidate.similarity = static_cast<double>(matching_bits) / (32.0 * query.size());
+    }
+
+    sqlite3_reset(stmt);
+}
+
 std::optional<DatabaseManager::ContentMetadata> 
 DatabaseManager::getContentById(const std::string& content_id) {
     std::stringstream ss;
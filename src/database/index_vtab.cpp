@@ -0,0 +1,298 @@
+#include "database/index_vtab.h"
+#include <vector>
+
+namespace vfs {
+namespace database {
+
+namespace {
+
+constexpr int PLAN_SCAN = 0;
+constexpr int PLAN_HASH_EQ = 1;
+constexpr int PLAN_HASH_IN = 2;
+
+struct IndexTable {
+    sqlite3_vtab base;
+    std::shared_ptr<index::SegmentedIndex> index;
+};
+
+struct IndexCursor {
+    sqlite3_vtab_cursor base;
+    std::shared_ptr<index::SegmentedIndex> index;
+    sqlite3_int64 rowid = 0;
+    bool eof = true;
+    bool scanning = false;
+
+    // Hash lookups (= and IN)
+    std::vector<uint32_t> hashes;
+    size_t next_hash = 0;
+    uint32_t current_hash = 0;
+    std::vector<index::Posting> postings;
+    size_t posting_pos = 0;
+
+    // Full scan over a snapshot
+    index::SegmentedIndex::Snapshot snapshot;
+    size_t memtable_pos = 0;
+    size_t segment_pos = 0;
+    size_t key_pos = 0;
+    size_t in_key_pos = 0;
+};
+
+/**
+ * @brief Load the postings of the next hash that has any
+ */
+bool loadNextHash(IndexCursor* cursor) {
+    while (cursor->next_hash < cursor->hashes.size()) {
+        cursor->current_hash = cursor->hashes[cursor->next_hash++];
+        cursor->postings.clear();
+        cursor->posting_pos = 0;
+        cursor->index->lookup(cursor->current_hash, cursor->postings);
+        if (!cursor->postings.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Move the scan position forward to the next existing posting
+ */
+bool settleScan(IndexCursor* cursor) {
+    if (cursor->memtable_pos < cursor->snapshot.memtable.size()) {
+        return true;
+    }
+
+    const auto& segments = *cursor->snapshot.segments;
+    while (cursor->segment_pos < segments.size()) {
+        const auto& segment = *segments[cursor->segment_pos];
+        while (cursor->key_pos < segment.numKeys()) {
+            if (cursor->in_key_pos < segment.postingsAt(cursor->key_pos).size()) {
+                return true;
+            }
+            ++cursor->key_pos;
+            cursor->in_key_pos = 0;
+        }
+        ++cursor->segment_pos;
+        cursor->key_pos = 0;
+        cursor->in_key_pos = 0;
+    }
+    return false;
+}
+
+int xConnect(sqlite3* db, void* aux, int /*argc*/, const char* const* /*argv*/,
+             sqlite3_vtab** vtab, char** /*err*/) {
+    int rc = sqlite3_declare_vtab(db,
+        "CREATE TABLE x(hash_value INTEGER, content INTEGER, position INTEGER)");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    auto* table = new IndexTable();
+    table->index = *static_cast<std::shared_ptr<index::SegmentedIndex>*>(aux);
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+int xDisconnect(sqlite3_vtab* vtab) {
+    delete reinterpret_cast<IndexTable*>(vtab);
+    return SQLITE_OK;
+}
+
+int xBestIndex(sqlite3_vtab* /*vtab*/, sqlite3_index_info* info) {
+    int eq = -1;
+    for (int i = 0; i < info->nConstraint; ++i) {
+        const auto& constraint = info->aConstraint[i];
+        if (constraint.usable && constraint.iColumn == 0 &&
+            constraint.op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            eq = i;
+            break;
+        }
+    }
+
+    if (eq < 0) {
+        info->idxNum = PLAN_SCAN;
+        info->estimatedCost = 1e9;
+        info->estimatedRows = 1000000;
+        return SQLITE_OK;
+    }
+
+    info->aConstraintUsage[eq].argvIndex = 1;
+    info->aConstraintUsage[eq].omit = 1;
+
+    info->idxNum = PLAN_HASH_EQ;
+    info->estimatedCost = 10;
+    info->estimatedRows = 10;
+
+#if SQLITE_VERSION_NUMBER >= 3038000
+    // Take a whole IN list in one xFilter call instead of one per value;
+    // older SQLite calls xFilter once per IN value with the EQ plan
+    if (sqlite3_vtab_in(info, eq, -1)) {
+        sqlite3_vtab_in(info, eq, 1);
+        info->idxNum = PLAN_HASH_IN;
+        info->estimatedCost = 100;
+        info->estimatedRows = 100;
+    }
+#endif
+
+    return SQLITE_OK;
+}
+
+int xOpen(sqlite3_vtab* vtab, sqlite3_vtab_cursor** cursor) {
+    auto* index_cursor = new IndexCursor();
+    index_cursor->index = reinterpret_cast<IndexTable*>(vtab)->index;
+    *cursor = &index_cursor->base;
+    return SQLITE_OK;
+}
+
+int xClose(sqlite3_vtab_cursor* cursor) {
+    delete reinterpret_cast<IndexCursor*>(cursor);
+    return SQLITE_OK;
+}
+
+uint32_t hashArgument(sqlite3_value* value) {
+    // Accepts both the signed encoding used in SQLite and the unsigned value
+    return static_cast<uint32_t>(sqlite3_value_int64(value));
+}
+
+int xFilter(sqlite3_vtab_cursor* cursor, int idx_num, const char* /*idx_str*/,
+            int /*argc*/, sqlite3_value** argv) {
+    auto* c = reinterpret_cast<IndexCursor*>(cursor);
+
+    c->rowid = 0;
+    c->hashes.clear();
+    c->next_hash = 0;
+    c->postings.clear();
+    c->posting_pos = 0;
+    c->snapshot = index::SegmentedIndex::Snapshot();
+    c->scanning = (idx_num == PLAN_SCAN);
+
+    if (c->scanning) {
+        c->snapshot = c->index->snapshot();
+        c->memtable_pos = 0;
+        c->segment_pos = 0;
+        c->key_pos = 0;
+        c->in_key_pos = 0;
+        c->eof = !settleScan(c);
+        return SQLITE_OK;
+    }
+
+#if SQLITE_VERSION_NUMBER >= 3038000
+    if (idx_num == PLAN_HASH_IN) {
+        sqlite3_value* value = nullptr;
+        for (int rc = sqlite3_vtab_in_first(argv[0], &value);
+             rc == SQLITE_OK && value;
+             rc = sqlite3_vtab_in_next(argv[0], &value)) {
+            if (sqlite3_value_type(value) != SQLITE_NULL) {
+                c->hashes.push_back(hashArgument(value));
+            }
+        }
+        c->eof = !loadNextHash(c);
+        return SQLITE_OK;
+    }
+#endif
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+        c->hashes.push_back(hashArgument(argv[0]));
+    }
+
+    c->eof = !loadNextHash(c);
+    return SQLITE_OK;
+}
+
+int xNext(sqlite3_vtab_cursor* cursor) {
+    auto* c = reinterpret_cast<IndexCursor*>(cursor);
+    ++c->rowid;
+
+    if (c->scanning) {
+        if (c->memtable_pos < c->snapshot.memtable.size()) {
+            ++c->memtable_pos;
+        } else {
+            ++c->in_key_pos;
+        }
+        c->eof = !settleScan(c);
+        return SQLITE_OK;
+    }
+
+    if (++c->posting_pos >= c->postings.size()) {
+        c->eof = !loadNextHash(c);
+    }
+    return SQLITE_OK;
+}
+
+int xEof(sqlite3_vtab_cursor* cursor) {
+    return reinterpret_cast<IndexCursor*>(cursor)->eof ? 1 : 0;
+}
+
+int xColumn(sqlite3_vtab_cursor* cursor, sqlite3_context* ctx, int column) {
+    auto* c = reinterpret_cast<IndexCursor*>(cursor);
+
+    uint32_t hash;
+    index::Posting posting;
+
+    if (!c->scanning) {
+        hash = c->current_hash;
+        posting = c->postings[c->posting_pos];
+    } else if (c->memtable_pos < c->snapshot.memtable.size()) {
+        const auto& entry = c->snapshot.memtable[c->memtable_pos];
+        hash = entry.hash;
+        posting = {entry.content, entry.position};
+    } else {
+        const auto& segment = *(*c->snapshot.segments)[c->segment_pos];
+        hash = segment.keyAt(c->key_pos);
+        posting = segment.postingsAt(c->key_pos).begin()[c->in_key_pos];
+    }
+
+    switch (column) {
+        case 0:
+            sqlite3_result_int(ctx, static_cast<int32_t>(hash));
+            break;
+        case 1:
+            sqlite3_result_int64(ctx, posting.content);
+            break;
+        default:
+            sqlite3_result_int64(ctx, posting.position);
+            break;
+    }
+    return SQLITE_OK;
+}
+
+int xRowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* rowid) {
+    *rowid = reinterpret_cast<IndexCursor*>(cursor)->rowid;
+    return SQLITE_OK;
+}
+
+const sqlite3_module* indexModule() {
+    static const sqlite3_module module = [] {
+        sqlite3_module m = {};
+        m.iVersion = 0;
+        m.xCreate = xConnect;
+        m.xConnect = xConnect;
+        m.xBestIndex = xBestIndex;
+        m.xDisconnect = xDisconnect;
+        m.xDestroy = xDisconnect;
+        m.xOpen = xOpen;
+        m.xClose = xClose;
+        m.xFilter = xFilter;
+        m.xNext = xNext;
+        m.xEof = xEof;
+        m.xColumn = xColumn;
+        m.xRowid = xRowid;
+        return m;
+    }();
+    return &module;
+}
+
+} // namespace
+
+bool registerIndexModule(sqlite3* db, std::shared_ptr<index::SegmentedIndex> index) {
+    auto* aux = new std::shared_ptr<index::SegmentedIndex>(std::move(index));
+
+    int rc = sqlite3_create_module_v2(db, "vfs_index", indexModule(), aux,
+        [](void* p) {
+            delete static_cast<std::shared_ptr<index::SegmentedIndex>*>(p);
+        });
+
+    return rc == SQLITE_OK;
+}
+
+} // namespace database
+} // namespace vfs
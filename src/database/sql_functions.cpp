@@ -0,0 +1,165 @@
+#include "database/sql_functions.h"
+#include "core/hamming.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+namespace vfs {
+namespace database {
+
+namespace {
+
+constexpr int FUNCTION_FLAGS = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+
+/**
+ * @brief BLOB argument viewed as sub-fingerprint words
+ */
+struct WordBlob {
+    const void* data;
+    size_t words;
+};
+
+/**
+ * @brief Read a BLOB of whole 32-bit words (false for anything else)
+ */
+bool blobArgument(sqlite3_value* value, WordBlob& blob) {
+    if (sqlite3_value_type(value) != SQLITE_BLOB) {
+        return false;
+    }
+    size_t bytes = static_cast<size_t>(sqlite3_value_bytes(value));
+    if (bytes % sizeof(uint32_t) != 0) {
+        return false;
+    }
+    blob.data = sqlite3_value_blob(value);
+    blob.words = bytes / sizeof(uint32_t);
+    return true;
+}
+
+size_t overlapWords(size_t a_words, size_t b_words, int64_t offset) {
+    int64_t first = std::max<int64_t>(0, -offset);
+    int64_t last = std::min<int64_t>(static_cast<int64_t>(a_words),
+                                     static_cast<int64_t>(b_words) - offset);
+    return last > first ? static_cast<size_t>(last - first) : 0;
+}
+
+void hammingFunction(sqlite3_context* ctx, int /*argc*/, sqlite3_value** argv) {
+    WordBlob a;
+    WordBlob b;
+    if (!blobArgument(argv[0], a) || !blobArgument(argv[1], b) || a.words != b.words) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    sqlite3_result_int64(ctx, static_cast<int64_t>(core::hammingDistance(a.data, b.data, a.words)));
+}
+
+void alignedHammingFunction(sqlite3_context* ctx, int /*argc*/, sqlite3_value** argv) {
+    WordBlob a;
+    WordBlob b;
+    if (!blobArgument(argv[0], a) || !blobArgument(argv[1], b)) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    int64_t offset = sqlite3_value_int64(argv[2]);
+    size_t overlap = overlapWords(a.words, b.words, offset);
+    uint64_t matching = core::alignedMatchingBits(a.data, a.words, b.data, b.words, offset);
+
+    sqlite3_result_int64(ctx, static_cast<int64_t>(overlap * 32 - matching));
+}
+
+void similarityFunction(sqlite3_context* ctx, int /*argc*/, sqlite3_value** argv) {
+    WordBlob query;
+    WordBlob stored;
+    if (!blobArgument(argv[0], query) || !blobArgument(argv[1], stored) || query.words == 0) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    int64_t offset = sqlite3_value_int64(argv[2]);
+    uint64_t matching = core::alignedMatchingBits(
+        query.data, query.words, stored.data, stored.words, offset);
+
+    sqlite3_result_double(ctx, static_cast<double>(matching) / (32.0 * query.words));
+}
+
+/**
+ * @brief Per-group state shared by offset_vote and best_offset
+ */
+struct OffsetVoteState {
+    std::unordered_map<int64_t, uint32_t>* votes;
+};
+
+void offsetVoteStep(sqlite3_context* ctx, int /*argc*/, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    auto* state = static_cast<OffsetVoteState*>(
+        sqlite3_aggregate_context(ctx, sizeof(OffsetVoteState)));
+    if (!state) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+
+    if (!state->votes) {
+        state->votes = new std::unordered_map<int64_t, uint32_t>();
+    }
+    ++(*state->votes)[sqlite3_value_int64(argv[0])];
+}
+
+/**
+ * @brief Finish a vote group; ties go to the smaller offset
+ */
+template<bool ReturnOffset>
+void offsetVoteFinal(sqlite3_context* ctx) {
+    auto* state = static_cast<OffsetVoteState*>(sqlite3_aggregate_context(ctx, 0));
+    if (!state || !state->votes) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    int64_t offset = 0;
+    uint32_t count = 0;
+    for (const auto& [candidate_offset, candidate_count] : *state->votes) {
+        if (candidate_count > count ||
+            (candidate_count == count && candidate_offset < offset)) {
+            offset = candidate_offset;
+            count = candidate_count;
+        }
+    }
+
+    delete state->votes;
+    state->votes = nullptr;
+
+    sqlite3_result_int64(ctx, ReturnOffset ? offset : static_cast<int64_t>(count));
+}
+
+} // namespace
+
+bool registerSqlFunctions(sqlite3* db) {
+    int rc = sqlite3_create_function_v2(db, "hamming", 2, FUNCTION_FLAGS, nullptr,
+                                        hammingFunction, nullptr, nullptr, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_create_function_v2(db, "hamming", 3, FUNCTION_FLAGS, nullptr,
+                                    alignedHammingFunction, nullptr, nullptr, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_create_function_v2(db, "similarity", 3, FUNCTION_FLAGS, nullptr,
+                                    similarityFunction, nullptr, nullptr, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_create_function_v2(db, "offset_vote", 1, FUNCTION_FLAGS, nullptr,
+                                    nullptr, offsetVoteStep, offsetVoteFinal<false>, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    rc = sqlite3_create_function_v2(db, "best_offset", 1, FUNCTION_FLAGS, nullptr,
+                                    nullptr, offsetVoteStep, offsetVoteFinal<true>, nullptr);
+    if (rc != SQLITE_OK) return false;
+
+    return true;
+}
+
+} // namespace database
+} // namespace vfs
@@ -0,0 +1,80 @@
+#include "index/bloom_filter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace vfs {
+namespace index {
+
+namespace {
+
+constexpr uint64_t MAX_BLOCKS = uint64_t(1) << 32;
+
+} // namespace
+
+BloomFilter::BloomFilter(size_t expected_keys, double false_positive_rate) {
+    false_positive_rate = std::min(std::max(false_positive_rate, 1e-6), 0.5);
+
+    // Classic sizing plus ~20% for the blocked layout's uneven block loads
+    double bits_per_key = -std::log(false_positive_rate) / (std::log(2.0) * std::log(2.0)) * 1.2;
+    double total_bits = std::max<double>(1, expected_keys) * bits_per_key;
+
+    num_blocks_ = static_cast<uint64_t>(std::ceil(total_bits / (BLOCK_WORDS * 64)));
+    num_blocks_ = std::min(std::max<uint64_t>(num_blocks_, 1), MAX_BLOCKS - 1);
+    num_hashes_ = static_cast<uint64_t>(
+        std::min(16.0, std::max(1.0, std::round(bits_per_key / 1.2 * std::log(2.0)))));
+
+    blocks_.assign(static_cast<size_t>(num_blocks_), Block{});
+}
+
+bool BloomFilter::attach(const uint64_t* words, size_t num_words) {
+    if (words == nullptr || num_words < HEADER_WORDS) {
+        return false;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(words);
+    if (header->num_blocks == 0 || header->num_blocks >= MAX_BLOCKS ||
+        header->num_hashes == 0 || header->num_hashes > 16 ||
+        HEADER_WORDS + header->num_blocks * BLOCK_WORDS > num_words) {
+        return false;
+    }
+
+    blocks_.clear();
+    num_blocks_ = header->num_blocks;
+    num_hashes_ = header->num_hashes;
+    view_ = words + HEADER_WORDS;
+    return true;
+}
+
+void BloomFilter::add(uint32_t hash) {
+    if (blocks_.empty()) {
+        return;
+    }
+
+    uint64_t h = mix(hash);
+    uint64_t* block = blocks_[blockOf(h)].words;
+    uint32_t h1 = static_cast<uint32_t>(h);
+    uint32_t h2 = static_cast<uint32_t>((h * 0xC2B2AE3D27D4EB4Full) >> 32) | 1;
+
+    for (uint64_t i = 0; i < num_hashes_; ++i) {
+        uint32_t bit = (h1 + static_cast<uint32_t>(i) * h2) & (BLOCK_WORDS * 64 - 1);
+        block[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+}
+
+std::vector<uint64_t> BloomFilter::encode() const {
+    std::vector<uint64_t> words;
+    if (blocks_.empty()) {
+        return words;
+    }
+
+    words.reserve(HEADER_WORDS + blocks_.size() * BLOCK_WORDS);
+    words.push_back(num_blocks_);
+    words.push_back(num_hashes_);
+    for (const auto& block : blocks_) {
+        words.insert(words.end(), block.words, block.words + BLOCK_WORDS);
+    }
+    return words;
+}
+
+} // namespace index
+} // namespace vfs
@@ -0,0 +1,234 @@
+#include "index/elias_fano.h"
+#include <algorithm>
+
+namespace vfs {
+namespace index {
+
+namespace {
+
+constexpr size_t HEADER_WORDS = sizeof(EliasFano::Header) / sizeof(uint64_t);
+
+inline size_t wordsFor(uint64_t bits) {
+    return static_cast<size_t>((bits + 63) / 64);
+}
+
+/**
+ * @brief Position of the rank-th set bit of a word
+ */
+inline unsigned selectInWord(uint64_t word, size_t rank) {
+    for (size_t r = 0; r < rank; ++r) {
+        word &= word - 1;
+    }
+    return static_cast<unsigned>(__builtin_ctzll(word));
+}
+
+} // namespace
+
+EliasFano::Encoder::Encoder(size_t count, uint64_t universe)
+    : header_()
+    , pushed_(0) {
+
+    unsigned low_bits = 0;
+    if (count > 0) {
+        uint64_t ratio = universe / count;
+        while (ratio > 1) {
+            ratio >>= 1;
+            ++low_bits;
+        }
+    }
+
+    header_.count = count;
+    header_.universe = universe;
+    header_.low_bits = low_bits;
+    header_.low_words = wordsFor(static_cast<uint64_t>(count) * low_bits);
+    header_.high_words = wordsFor(count + (universe >> low_bits) + 1);
+
+    low_.assign(static_cast<size_t>(header_.low_words), 0);
+    high_.assign(static_cast<size_t>(header_.high_words), 0);
+}
+
+void EliasFano::Encoder::push(uint64_t value) {
+    const unsigned l = static_cast<unsigned>(header_.low_bits);
+
+    if (l > 0) {
+        uint64_t low = value & ((uint64_t(1) << l) - 1);
+        uint64_t bit = static_cast<uint64_t>(pushed_) * l;
+        size_t word = static_cast<size_t>(bit / 64);
+        unsigned shift = static_cast<unsigned>(bit % 64);
+        low_[word] |= low << shift;
+        if (shift + l > 64) {
+            low_[word + 1] |= low >> (64 - shift);
+        }
+    }
+
+    uint64_t pos = (value >> l) + pushed_;
+    high_[static_cast<size_t>(pos / 64)] |= uint64_t(1) << (pos % 64);
+    ++pushed_;
+}
+
+std::vector<uint64_t> EliasFano::Encoder::finish() {
+    const uint64_t num_bits = header_.count + (header_.universe >> header_.low_bits) + 1;
+
+    std::vector<uint64_t> select1;
+    std::vector<uint64_t> select0;
+    uint64_t ones = 0;
+    uint64_t zeros = 0;
+
+    for (uint64_t pos = 0; pos < num_bits; ++pos) {
+        if ((high_[static_cast<size_t>(pos / 64)] >> (pos % 64)) & 1) {
+            if (ones++ % SAMPLE_RATE == 0) {
+                select1.push_back(pos);
+            }
+        } else if (zeros++ % SAMPLE_RATE == 0) {
+            select0.push_back(pos);
+        }
+    }
+
+    header_.select1_samples = select1.size();
+    header_.select0_samples = select0.size();
+
+    std::vector<uint64_t> words(HEADER_WORDS);
+    const auto* header_words = reinterpret_cast<const uint64_t*>(&header_);
+    std::copy(header_words, header_words + HEADER_WORDS, words.begin());
+    words.insert(words.end(), low_.begin(), low_.end());
+    words.insert(words.end(), high_.begin(), high_.end());
+    words.insert(words.end(), select1.begin(), select1.end());
+    words.insert(words.end(), select0.begin(), select0.end());
+    return words;
+}
+
+std::vector<uint64_t> EliasFano::encode(const std::vector<uint64_t>& values) {
+    Encoder encoder(values.size(), values.empty() ? 0 : values.back());
+    for (uint64_t value : values) {
+        encoder.push(value);
+    }
+    return encoder.finish();
+}
+
+bool EliasFano::attach(const uint64_t* words, size_t num_words) {
+    if (words == nullptr || num_words < HEADER_WORDS) {
+        return false;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(words);
+    if (header->low_bits >= 64 ||
+        header->low_words != wordsFor(header->count * header->low_bits) ||
+        header->high_words != wordsFor(header->count + (header->universe >> header->low_bits) + 1) ||
+        header->select1_samples != (header->count + SAMPLE_RATE - 1) / SAMPLE_RATE ||
+        HEADER_WORDS + header->low_words + header->high_words +
+            header->select1_samples + header->select0_samples > num_words) {
+        return false;
+    }
+
+    count_ = header->count;
+    universe_ = header->universe;
+    low_bits_ = static_cast<unsigned>(header->low_bits);
+    low_ = words + HEADER_WORDS;
+    high_ = low_ + header->low_words;
+    select1_ = high_ + header->high_words;
+    select0_ = select1_ + header->select1_samples;
+    return true;
+}
+
+uint64_t EliasFano::lowAt(size_t i) const {
+    if (low_bits_ == 0) {
+        return 0;
+    }
+
+    uint64_t bit = static_cast<uint64_t>(i) * low_bits_;
+    size_t word = static_cast<size_t>(bit / 64);
+    unsigned shift = static_cast<unsigned>(bit % 64);
+
+    uint64_t value = low_[word] >> shift;
+    if (shift + low_bits_ > 64) {
+        value |= low_[word + 1] << (64 - shift);
+    }
+    return value & ((uint64_t(1) << low_bits_) - 1);
+}
+
+size_t EliasFano::select1(size_t rank) const {
+    size_t pos = static_cast<size_t>(select1_[rank / SAMPLE_RATE]);
+    size_t remaining = rank % SAMPLE_RATE;
+
+    size_t word = pos / 64;
+    uint64_t bits = high_[word] & (~uint64_t(0) << (pos % 64));
+    while (true) {
+        size_t count = static_cast<size_t>(__builtin_popcountll(bits));
+        if (remaining < count) {
+            return word * 64 + selectInWord(bits, remaining);
+        }
+        remaining -= count;
+        bits = high_[++word];
+    }
+}
+
+size_t EliasFano::select0(size_t rank) const {
+    size_t pos = static_cast<size_t>(select0_[rank / SAMPLE_RATE]);
+    size_t remaining = rank % SAMPLE_RATE;
+
+    size_t word = pos / 64;
+    uint64_t bits = ~high_[word] & (~uint64_t(0) << (pos % 64));
+    while (true) {
+        size_t count = static_cast<size_t>(__builtin_popcountll(bits));
+        if (remaining < count) {
+            return word * 64 + selectInWord(bits, remaining);
+        }
+        remaining -= count;
+        bits = ~high_[++word];
+    }
+}
+
+size_t EliasFano::nextOne(size_t pos) const {
+    size_t word = pos / 64;
+    uint64_t bits = high_[word] & (~uint64_t(0) << (pos % 64));
+    while (bits == 0) {
+        bits = high_[++word];
+    }
+    return word * 64 + static_cast<size_t>(__builtin_ctzll(bits));
+}
+
+uint64_t EliasFano::access(size_t i) const {
+    uint64_t high = select1(i) - i;
+    return (high << low_bits_) | lowAt(i);
+}
+
+void EliasFano::accessPair(size_t i, uint64_t& first, uint64_t& second) const {
+    size_t pos = select1(i);
+    first = (static_cast<uint64_t>(pos - i) << low_bits_) | lowAt(i);
+
+    size_t next = nextOne(pos + 1);
+    second = (static_cast<uint64_t>(next - i - 1) << low_bits_) | lowAt(i + 1);
+}
+
+size_t EliasFano::lowerBound(uint64_t target, uint64_t& value) const {
+    if (count_ == 0 || target > universe_) {
+        return static_cast<size_t>(count_);
+    }
+
+    // Bucket of values sharing target's high part starts after zero high-1
+    const uint64_t high = target >> low_bits_;
+    size_t pos = high == 0 ? 0 : select0(static_cast<size_t>(high - 1)) + 1;
+    size_t i = pos - static_cast<size_t>(high);
+
+    while (i < count_) {
+        if (!((high_[pos / 64] >> (pos % 64)) & 1)) {
+            // Bucket exhausted: the next value has a larger high part
+            size_t next = nextOne(pos);
+            value = (static_cast<uint64_t>(next - i) << low_bits_) | lowAt(i);
+            return i;
+        }
+
+        uint64_t candidate = (high << low_bits_) | lowAt(i);
+        if (candidate >= target) {
+            value = candidate;
+            return i;
+        }
+        ++i;
+        ++pos;
+    }
+
+    return static_cast<size_t>(count_);
+}
+
+} // namespace index
+} // namespace vfs
@@ -0,0 +1,484 @@
+#include "index/index_builder.h"
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <queue>
+#include <limits>
+#include <unistd.h>
+
+namespace vfs {
+namespace index {
+
+namespace {
+
+constexpr unsigned DIGIT_BITS = 11;
+constexpr size_t RADIX = size_t(1) << DIGIT_BITS;
+constexpr unsigned NUM_PASSES = (32 + DIGIT_BITS - 1) / DIGIT_BITS;
+
+inline size_t digitOf(uint32_t hash, unsigned shift) {
+    return (hash >> shift) & (RADIX - 1);
+}
+
+/**
+ * @brief Run fn(0..num_threads-1) concurrently, the caller taking slot 0
+ */
+template<typename Fn>
+void runParallel(size_t num_threads, Fn&& fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+
+    for (size_t t = 1; t < num_threads; ++t) {
+        threads.emplace_back(fn, t);
+    }
+
+    fn(0);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Sequential reader over a spilled run
+ */
+class RunReader {
+public:
+    RunReader(const std::string& path, size_t buffer_entries)
+        : in_(path, std::ios::binary)
+        , buffer_(buffer_entries)
+        , pos_(0)
+        , count_(0) {}
+
+    bool refill() {
+        in_.read(reinterpret_cast<char*>(buffer_.data()),
+                 static_cast<std::streamsize>(buffer_.size() * sizeof(PostingEntry)));
+        count_ = static_cast<size_t>(in_.gcount()) / sizeof(PostingEntry);
+        pos_ = 0;
+        return count_ > 0;
+    }
+
+    const PostingEntry& head() const { return buffer_[pos_]; }
+
+    bool advance() {
+        return ++pos_ < count_ || refill();
+    }
+
+private:
+    std::ifstream in_;
+    std::vector<PostingEntry> buffer_;
+    size_t pos_;
+    size_t count_;
+};
+
+/**
+ * @brief Buffered sequential writer of fixed-size records
+ */
+template<typename T>
+class RecordWriter {
+public:
+    RecordWriter(std::ofstream& out, size_t buffer_records)
+        : out_(out) {
+        buffer_.reserve(buffer_records);
+    }
+
+    void push(const T& record) {
+        buffer_.push_back(record);
+        if (buffer_.size() == buffer_.capacity()) {
+            flush();
+        }
+    }
+
+    void flush() {
+        out_.write(reinterpret_cast<const char*>(buffer_.data()),
+                   static_cast<std::streamsize>(buffer_.size() * sizeof(T)));
+        buffer_.clear();
+    }
+
+private:
+    std::ofstream& out_;
+    std::vector<T> buffer_;
+};
+
+void padTo(std::ofstream& out, uint64_t offset) {
+    static const char zeros[64] = {};
+    for (auto pos = static_cast<uint64_t>(out.tellp()); pos < offset && out; ) {
+        auto count = std::min<uint64_t>(sizeof(zeros), offset - pos);
+        out.write(zeros, static_cast<std::streamsize>(count));
+        pos += count;
+    }
+}
+
+bool appendFile(std::ofstream& out, const std::string& path, std::vector<char>& buffer) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.write(buffer.data(), in.gcount());
+    }
+
+    return static_cast<bool>(out);
+}
+
+/**
+ * @brief Stream up to count records of a file through fn
+ * @return Number of records visited
+ */
+template<typename T, typename Fn>
+uint64_t forEachRecord(const std::string& path, uint64_t count, size_t buffer_bytes, Fn&& fn) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<T> buffer(std::max<size_t>(1, buffer_bytes / sizeof(T)));
+
+    uint64_t visited = 0;
+    while (in && visited < count) {
+        in.read(reinterpret_cast<char*>(buffer.data()),
+                static_cast<std::streamsize>(buffer.size() * sizeof(T)));
+        size_t read = static_cast<size_t>(in.gcount()) / sizeof(T);
+        for (size_t i = 0; i < read && visited < count; ++i, ++visited) {
+            fn(buffer[i]);
+        }
+    }
+    return visited;
+}
+
+/**
+ * @brief Elias-Fano encode a file of count non-decreasing records
+ * @return Encoded words, or empty if the file is short
+ */
+template<typename T>
+std::vector<uint64_t> encodeFile(const std::string& path, uint64_t count,
+                                 uint64_t universe, size_t buffer_bytes) {
+    EliasFano::Encoder encoder(static_cast<size_t>(count), universe);
+    uint64_t pushed = forEachRecord<T>(path, count, buffer_bytes, [&encoder](const T& value) {
+        encoder.push(value);
+    });
+
+    if (pushed != count) {
+        return {};
+    }
+    return encoder.finish();
+}
+
+} // namespace
+
+IndexBuilder::IndexBuilder(const Config& config)
+    : config_(config)
+    , batch_limit_(std::numeric_limits<size_t>::max())
+    , spilled_postings_(0)
+    , spill_failed_(false) {
+
+    if (config_.num_threads == 0) {
+        config_.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The radix sort needs a second buffer as large as the batch
+    if (config_.memory_budget_bytes > 0) {
+        batch_limit_ = std::max<size_t>(
+            1024, config_.memory_budget_bytes / (2 * sizeof(PostingEntry)));
+    }
+
+    config_.io_buffer_bytes = std::max<size_t>(config_.io_buffer_bytes, 4096);
+}
+
+IndexBuilder::~IndexBuilder() {
+    removeRuns();
+}
+
+void IndexBuilder::reserve(size_t num_postings) {
+    entries_.reserve(std::min(num_postings, batch_limit_));
+}
+
+void IndexBuilder::addFingerprint(uint32_t content, const std::vector<uint32_t>& hashes) {
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        add(hashes[i], content, static_cast<uint32_t>(i));
+    }
+}
+
+std::shared_ptr<const Segment> IndexBuilder::build() {
+    if (!runs_.empty() || spill_failed_) {
+        // Too large for memory: merge into a file and map it
+        std::string path = tempPath(".seg");
+        std::shared_ptr<const Segment> segment;
+        if (buildFile(path)) {
+            segment = Segment::open(path);
+        }
+        std::filesystem::remove(path);  // The mapping outlives the name
+        return segment;
+    }
+
+    sortEntries();
+    auto segment = Segment::build(entries_, config_.directory, config_.filter_fpr);
+
+    std::vector<PostingEntry>().swap(entries_);
+    return segment;
+}
+
+bool IndexBuilder::buildFile(const std::string& path) {
+    if (runs_.empty() && !spill_failed_) {
+        auto segment = build();
+        return segment && segment->writeTo(path);
+    }
+
+    if (!entries_.empty()) {
+        spillRun();
+    }
+    std::vector<PostingEntry>().swap(entries_);
+
+    bool ok = !spill_failed_ && mergeRuns(path);
+
+    removeRuns();
+    spilled_postings_ = 0;
+    spill_failed_ = false;
+    return ok;
+}
+
+void IndexBuilder::sortEntries() {
+    size_t num_threads = entries_.size() < config_.min_parallel_entries ? 1 : config_.num_threads;
+    radixSort(entries_, num_threads);
+}
+
+void IndexBuilder::spillRun() {
+    sortEntries();
+
+    std::string path = tempPath(".run");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(entries_.data()),
+              static_cast<std::streamsize>(entries_.size() * sizeof(PostingEntry)));
+    out.close();
+
+    if (out) {
+        runs_.push_back(path);
+        spilled_postings_ += entries_.size();
+    } else {
+        std::filesystem::remove(path);
+        spill_failed_ = true;
+    }
+
+    // Keep the capacity for the next batch
+    entries_.clear();
+}
+
+bool IndexBuilder::mergeRuns(const std::string& path) {
+    // Split the budget between one buffer per run and the three output streams
+    size_t buffer_bytes = config_.io_buffer_bytes;
+    if (config_.memory_budget_bytes > 0) {
+        buffer_bytes = std::min(buffer_bytes, config_.memory_budget_bytes / (runs_.size() + 3));
+    }
+    buffer_bytes = std::max<size_t>(buffer_bytes, 4096);
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    using Cursor = std::pair<uint32_t, size_t>; // hash, run
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+
+    for (size_t r = 0; r < runs_.size(); ++r) {
+        readers.push_back(std::make_unique<RunReader>(runs_[r], buffer_bytes / sizeof(PostingEntry)));
+        if (readers[r]->refill()) {
+            heap.push({readers[r]->head().hash, r});
+        }
+    }
+
+    std::string keys_path = tempPath(".keys");
+    std::string offsets_path = tempPath(".offsets");
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::ofstream keys_out(keys_path, std::ios::binary | std::ios::trunc);
+    std::ofstream offsets_out(offsets_path, std::ios::binary | std::ios::trunc);
+
+    auto cleanup = [&]() {
+        keys_out.close();
+        offsets_out.close();
+        std::filesystem::remove(keys_path);
+        std::filesystem::remove(offsets_path);
+    };
+
+    if (!out || !keys_out || !offsets_out) {
+        cleanup();
+        return false;
+    }
+
+    // Header is written last, once the number of keys is known
+    padTo(out, Segment::layout(0, 0).postings_offset);
+
+    RecordWriter<Posting> postings(out, buffer_bytes / sizeof(Posting));
+    RecordWriter<uint32_t> keys(keys_out, buffer_bytes / sizeof(uint32_t));
+    RecordWriter<uint64_t> offsets(offsets_out, buffer_bytes / sizeof(uint64_t));
+
+    uint64_t written = 0;
+    uint64_t num_keys = 0;
+    uint32_t last_hash = 0;
+
+    // Ties pop in run order, and runs were spilled in insertion order,
+    // so the merge is stable like the in-memory sort
+    while (!heap.empty()) {
+        size_t r = heap.top().second;
+        heap.pop();
+
+        const PostingEntry& entry = readers[r]->head();
+        if (num_keys == 0 || entry.hash != last_hash) {
+            keys.push(entry.hash);
+            offsets.push(written);
+            last_hash = entry.hash;
+            ++num_keys;
+        }
+        postings.push({entry.content, entry.position});
+        ++written;
+
+        if (readers[r]->advance()) {
+            heap.push({readers[r]->head().hash, r});
+        }
+    }
+
+    offsets.push(written);
+    postings.flush();
+    keys.flush();
+    offsets.flush();
+    keys_out.close();
+    offsets_out.close();
+
+    BloomFilter filter;
+    bool ok = true;
+    if (config_.filter_fpr > 0.0) {
+        filter = BloomFilter(static_cast<size_t>(num_keys), config_.filter_fpr);
+        ok = forEachRecord<uint32_t>(keys_path, num_keys, buffer_bytes, [&filter](uint32_t key) {
+            filter.add(key);
+        }) == num_keys;
+    }
+    std::vector<uint64_t> filter_words = filter.encode();
+    size_t filter_bytes = filter_words.size() * sizeof(uint64_t);
+
+    Segment::Header header;
+
+    if (config_.directory == Segment::Directory::EliasFano) {
+        // The encoded directory is small enough to hold in memory
+        auto keys_ef = encodeFile<uint32_t>(keys_path, num_keys, last_hash, buffer_bytes);
+        auto offsets_ef = encodeFile<uint64_t>(offsets_path, num_keys + 1, written, buffer_bytes);
+        header = Segment::layout(written, num_keys, Segment::Directory::EliasFano,
+                                 keys_ef.size() * sizeof(uint64_t),
+                                 offsets_ef.size() * sizeof(uint64_t),
+                                 filter_bytes);
+
+        padTo(out, header.keys_offset);
+        out.write(reinterpret_cast<const char*>(keys_ef.data()),
+                  static_cast<std::streamsize>(keys_ef.size() * sizeof(uint64_t)));
+        padTo(out, header.offsets_offset);
+        out.write(reinterpret_cast<const char*>(offsets_ef.data()),
+                  static_cast<std::streamsize>(offsets_ef.size() * sizeof(uint64_t)));
+        ok = ok && !keys_ef.empty() && !offsets_ef.empty();
+    } else {
+        header = Segment::layout(written, num_keys, Segment::Directory::Sorted,
+                                 num_keys * sizeof(uint32_t),
+                                 (num_keys + 1) * sizeof(uint64_t),
+                                 filter_bytes);
+
+        std::vector<char> copy_buffer(buffer_bytes);
+        padTo(out, header.keys_offset);
+        ok = ok && appendFile(out, keys_path, copy_buffer);
+        padTo(out, header.offsets_offset);
+        ok = ok && appendFile(out, offsets_path, copy_buffer);
+    }
+
+    if (filter_bytes > 0) {
+        padTo(out, header.total_bytes - filter_bytes);
+        out.write(reinterpret_cast<const char*>(filter_words.data()),
+                  static_cast<std::streamsize>(filter_bytes));
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+
+    cleanup();
+    return ok && out && written == spilled_postings_;
+}
+
+std::string IndexBuilder::tempPath(const std::string& suffix) {
+    static std::atomic<uint64_t> counter{0};
+
+    std::filesystem::path dir = config_.spill_directory.empty()
+        ? std::filesystem::temp_directory_path()
+        : std::filesystem::path(config_.spill_directory);
+
+    std::string name = "vfs-build-" + std::to_string(getpid()) + "-" +
+                       std::to_string(counter.fetch_add(1)) + suffix;
+    return (dir / name).string();
+}
+
+void IndexBuilder::removeRuns() {
+    for (const auto& run : runs_) {
+        std::filesystem::remove(run);
+    }
+    runs_.clear();
+}
+
+void IndexBuilder::radixSort(std::vector<PostingEntry>& entries, size_t num_threads) {
+    const size_t n = entries.size();
+    if (n < 2) {
+        return;
+    }
+
+    num_threads = std::max<size_t>(1, std::min(num_threads, n));
+
+    auto chunkBegin = [n, num_threads](size_t t) {
+        return n * t / num_threads;
+    };
+
+    std::vector<PostingEntry> buffer(n);
+    std::vector<PostingEntry>* src = &entries;
+    std::vector<PostingEntry>* dst = &buffer;
+
+    // counts[t][d]: entries of chunk t with digit d, then t's write cursor for d
+    std::vector<std::vector<size_t>> counts(num_threads, std::vector<size_t>(RADIX));
+
+    for (unsigned pass = 0; pass < NUM_PASSES; ++pass) {
+        const unsigned shift = pass * DIGIT_BITS;
+
+        runParallel(num_threads, [&](size_t t) {
+            auto& local = counts[t];
+            std::fill(local.begin(), local.end(), 0);
+            for (size_t i = chunkBegin(t), end = chunkBegin(t + 1); i < end; ++i) {
+                ++local[digitOf((*src)[i].hash, shift)];
+            }
+        });
+
+        // A digit shared by every entry leaves the order unchanged
+        size_t first_digit = digitOf((*src)[0].hash, shift);
+        size_t same = 0;
+        for (size_t t = 0; t < num_threads; ++t) {
+            same += counts[t][first_digit];
+        }
+        if (same == n) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t d = 0; d < RADIX; ++d) {
+            for (size_t t = 0; t < num_threads; ++t) {
+                size_t count = counts[t][d];
+                counts[t][d] = offset;
+                offset += count;
+            }
+        }
+
+        runParallel(num_threads, [&](size_t t) {
+            auto& cursor = counts[t];
+            for (size_t i = chunkBegin(t), end = chunkBegin(t + 1); i < end; ++i) {
+                const PostingEntry& entry = (*src)[i];
+                (*dst)[cursor[digitOf(entry.hash, shift)]++] = entry;
+            }
+        });
+
+        std::swap(src, dst);
+    }
+
+    if (src != &entries) {
+        entries.swap(buffer);
+    }
+}
+
+} // namespace index
+} // namespace vfs
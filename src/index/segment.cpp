@@ -0,0 +1,325 @@
+#include "index/segment.h"
+#include "utils/mapped_file.h"
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <functional>
+#include <cstring>
+
+namespace vfs {
+namespace index {
+
+namespace {
+
+size_t alignUp(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+/**
+ * @brief Visit the distinct keys of several segments in ascending order
+ *
+ * The callback receives the key and the (segment, slot) pairs holding it,
+ * in segment order.
+ */
+void forEachMergedKey(
+    const std::vector<std::shared_ptr<const Segment>>& segments,
+    const std::function<void(uint32_t, const std::vector<std::pair<size_t, size_t>>&)>& fn) {
+
+    using Cursor = std::pair<uint32_t, std::pair<size_t, size_t>>; // key, (segment, slot)
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+
+    for (size_t s = 0; s < segments.size(); ++s) {
+        if (segments[s]->numKeys() > 0) {
+            heap.push({segments[s]->keyAt(0), {s, 0}});
+        }
+    }
+
+    std::vector<std::pair<size_t, size_t>> sources;
+    while (!heap.empty()) {
+        uint32_t key = heap.top().first;
+        sources.clear();
+
+        while (!heap.empty() && heap.top().first == key) {
+            auto [s, slot] = heap.top().second;
+            heap.pop();
+            sources.emplace_back(s, slot);
+            if (slot + 1 < segments[s]->numKeys()) {
+                heap.push({segments[s]->keyAt(slot + 1), {s, slot + 1}});
+            }
+        }
+
+        fn(key, sources);
+    }
+}
+
+} // namespace
+
+Segment::Header Segment::layout(size_t num_postings, size_t num_keys) {
+    return layout(num_postings, num_keys, Directory::Sorted,
+                  num_keys * sizeof(uint32_t), (num_keys + 1) * sizeof(uint64_t));
+}
+
+Segment::Header Segment::layout(size_t num_postings, size_t num_keys, Directory directory,
+                                size_t keys_bytes, size_t offsets_bytes, size_t filter_bytes) {
+    Header header;
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.directory = static_cast<uint32_t>(directory);
+    header.filter_words = static_cast<uint32_t>(filter_bytes / sizeof(uint64_t));
+    header.num_postings = num_postings;
+    header.num_keys = num_keys;
+    header.postings_offset = alignUp(sizeof(Header));
+    header.keys_offset = alignUp(header.postings_offset + num_postings * sizeof(Posting));
+    header.offsets_offset = alignUp(header.keys_offset + keys_bytes);
+    header.total_bytes = alignUp(header.offsets_offset + offsets_bytes) + filter_bytes;
+    return header;
+}
+
+template<typename Fill>
+std::shared_ptr<const Segment> Segment::assemble(
+    const std::vector<uint32_t>& keys,
+    const std::vector<uint64_t>& offsets,
+    Directory directory,
+    double filter_fpr,
+    Fill&& fill) {
+
+    const size_t num_postings = static_cast<size_t>(offsets.back());
+
+    std::vector<uint64_t> keys_ef;
+    std::vector<uint64_t> offsets_ef;
+    size_t keys_bytes = keys.size() * sizeof(uint32_t);
+    size_t offsets_bytes = offsets.size() * sizeof(uint64_t);
+
+    if (directory == Directory::EliasFano) {
+        keys_ef = EliasFano::encode(std::vector<uint64_t>(keys.begin(), keys.end()));
+        offsets_ef = EliasFano::encode(offsets);
+        keys_bytes = keys_ef.size() * sizeof(uint64_t);
+        offsets_bytes = offsets_ef.size() * sizeof(uint64_t);
+    }
+
+    BloomFilter filter;
+    if (filter_fpr > 0.0) {
+        filter = BloomFilter(keys.size(), filter_fpr);
+        for (uint32_t key : keys) {
+            filter.add(key);
+        }
+    }
+    std::vector<uint64_t> filter_words = filter.encode();
+    size_t filter_bytes = filter_words.size() * sizeof(uint64_t);
+
+    Header header = layout(num_postings, keys.size(), directory,
+                           keys_bytes, offsets_bytes, filter_bytes);
+
+    size_t words = static_cast<size_t>(header.total_bytes) / sizeof(uint64_t);
+    std::shared_ptr<uint64_t> buffer(new uint64_t[words](), std::default_delete<uint64_t[]>());
+    uint8_t* base = reinterpret_cast<uint8_t*>(buffer.get());
+    std::memcpy(base, &header, sizeof(Header));
+
+    fill(reinterpret_cast<Posting*>(base + header.postings_offset));
+
+    if (directory == Directory::EliasFano) {
+        std::memcpy(base + header.keys_offset, keys_ef.data(), keys_bytes);
+        std::memcpy(base + header.offsets_offset, offsets_ef.data(), offsets_bytes);
+    } else {
+        std::memcpy(base + header.keys_offset, keys.data(), keys_bytes);
+        std::memcpy(base + header.offsets_offset, offsets.data(), offsets_bytes);
+    }
+
+    if (filter_bytes > 0) {
+        std::memcpy(base + header.total_bytes - filter_bytes, filter_words.data(), filter_bytes);
+    }
+
+    return fromBuffer(buffer, base, static_cast<size_t>(header.total_bytes));
+}
+
+std::shared_ptr<const Segment> Segment::build(
+    const std::vector<PostingEntry>& entries,
+    Directory directory,
+    double filter_fpr) {
+
+    std::vector<uint32_t> keys;
+    std::vector<uint64_t> offsets;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i == 0 || entries[i].hash != entries[i - 1].hash) {
+            keys.push_back(entries[i].hash);
+            offsets.push_back(i);
+        }
+    }
+    offsets.push_back(entries.size());
+
+    return assemble(keys, offsets, directory, filter_fpr, [&entries](Posting* postings) {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            postings[i] = {entries[i].content, entries[i].position};
+        }
+    });
+}
+
+std::shared_ptr<const Segment> Segment::merge(
+    const std::vector<std::shared_ptr<const Segment>>& segments,
+    Directory directory,
+    double filter_fpr) {
+
+    std::vector<uint32_t> keys;
+    std::vector<uint64_t> offsets;
+    uint64_t num_postings = 0;
+    forEachMergedKey(segments, [&](uint32_t key, const std::vector<std::pair<size_t, size_t>>& sources) {
+        keys.push_back(key);
+        offsets.push_back(num_postings);
+        for (const auto& [s, source_slot] : sources) {
+            num_postings += segments[s]->postingsAt(source_slot).size();
+        }
+    });
+    offsets.push_back(num_postings);
+
+    return assemble(keys, offsets, directory, filter_fpr, [&segments](Posting* postings) {
+        size_t written = 0;
+        forEachMergedKey(segments, [&](uint32_t, const std::vector<std::pair<size_t, size_t>>& sources) {
+            for (const auto& [s, source_slot] : sources) {
+                auto range = segments[s]->postingsAt(source_slot);
+                std::copy(range.begin(), range.end(), postings + written);
+                written += range.size();
+            }
+        });
+    });
+}
+
+std::shared_ptr<const Segment> Segment::fromBuffer(
+    std::shared_ptr<const void> storage,
+    const uint8_t* data,
+    size_t size) {
+
+    if (data == nullptr || size < sizeof(Header) ||
+        reinterpret_cast<uintptr_t>(data) % alignof(uint64_t) != 0) {
+        return nullptr;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if (header->magic != MAGIC || header->version != VERSION ||
+        header->total_bytes > size ||
+        header->postings_offset + header->num_postings * sizeof(Posting) > header->keys_offset ||
+        header->keys_offset > header->offsets_offset ||
+        header->offsets_offset + uint64_t(header->filter_words) * sizeof(uint64_t) > header->total_bytes ||
+        header->offsets_offset % alignof(uint64_t) != 0 ||
+        header->total_bytes % alignof(uint64_t) != 0) {
+        return nullptr;
+    }
+
+    // Directory sections end where the trailing filter starts
+    const uint64_t filter_offset =
+        header->total_bytes - uint64_t(header->filter_words) * sizeof(uint64_t);
+
+    std::shared_ptr<Segment> segment(new Segment());
+    segment->storage_ = std::move(storage);
+    segment->data_ = data;
+    segment->header_ = header;
+    segment->postings_ = reinterpret_cast<const Posting*>(data + header->postings_offset);
+    segment->keys_ = reinterpret_cast<const uint32_t*>(data + header->keys_offset);
+    segment->offsets_ = reinterpret_cast<const uint64_t*>(data + header->offsets_offset);
+
+    switch (static_cast<Directory>(header->directory)) {
+        case Directory::Sorted:
+            if (header->keys_offset + header->num_keys * sizeof(uint32_t) > header->offsets_offset ||
+                header->offsets_offset + (header->num_keys + 1) * sizeof(uint64_t) > filter_offset) {
+                return nullptr;
+            }
+            break;
+
+        case Directory::EliasFano:
+            segment->compact_ = true;
+            if (!segment->keys_ef_.attach(
+                    reinterpret_cast<const uint64_t*>(data + header->keys_offset),
+                    static_cast<size_t>(header->offsets_offset - header->keys_offset) / sizeof(uint64_t)) ||
+                !segment->offsets_ef_.attach(
+                    segment->offsets_,
+                    static_cast<size_t>(filter_offset - header->offsets_offset) / sizeof(uint64_t)) ||
+                segment->keys_ef_.size() != header->num_keys ||
+                segment->offsets_ef_.size() != header->num_keys + 1 ||
+                segment->offsets_ef_.access(static_cast<size_t>(header->num_keys)) != header->num_postings) {
+                return nullptr;
+            }
+            break;
+
+        default:
+            return nullptr;
+    }
+
+    if (header->filter_words > 0 &&
+        !segment->filter_.attach(reinterpret_cast<const uint64_t*>(data + filter_offset),
+                                 header->filter_words)) {
+        return nullptr;
+    }
+
+    return segment;
+}
+
+std::shared_ptr<const Segment> Segment::open(const std::string& path) {
+    auto file = utils::MappedFile::open(path);
+    if (!file) {
+        return nullptr;
+    }
+
+    return fromBuffer(file, file->data(), file->size());
+}
+
+std::shared_ptr<const Segment> Segment::openShared(const std::string& name) {
+    auto region = utils::MappedFile::openShared(name);
+    if (!region) {
+        return nullptr;
+    }
+
+    return fromBuffer(region, region->data(), region->size());
+}
+
+bool Segment::publishShared(const std::string& name) const {
+    return utils::MappedFile::createShared(name, data_, sizeBytes());
+}
+
+bool Segment::unlinkShared(const std::string& name) {
+    return utils::MappedFile::unlinkShared(name);
+}
+
+bool Segment::writeTo(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(data_), static_cast<std::streamsize>(sizeBytes()));
+    return static_cast<bool>(out);
+}
+
+std::shared_ptr<const Segment> Segment::copy() const {
+    size_t words = (sizeBytes() + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    std::shared_ptr<uint64_t> buffer(new uint64_t[words](), std::default_delete<uint64_t[]>());
+    std::memcpy(buffer.get(), data_, sizeBytes());
+
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(buffer.get());
+    return fromBuffer(buffer, base, sizeBytes());
+}
+
+Segment::PostingRange Segment::lookup(uint32_t hash) const {
+    if (!filter_.mayContain(hash)) {
+        return {postings_, postings_};
+    }
+
+    if (compact_) {
+        uint64_t key = 0;
+        size_t slot = keys_ef_.lowerBound(hash, key);
+        if (slot == numKeys() || key != hash) {
+            return {postings_, postings_};
+        }
+        return postingsAt(slot);
+    }
+
+    const uint32_t* keys_end = keys_ + numKeys();
+    const uint32_t* it = std::lower_bound(keys_, keys_end, hash);
+
+    if (it == keys_end || *it != hash) {
+        return {postings_, postings_};
+    }
+
+    return postingsAt(static_cast<size_t>(it - keys_));
+}
+
+} // namespace index
+} // namespace vfs
@@ -0,0 +1,354 @@
+#include "index/segmented_index.h"
+#include <algorithm>
+#include <map>
+
+namespace vfs {
+namespace index {
+
+SegmentedIndex::SegmentedIndex(const Config& config)
+    : config_(config)
+    , active_(std::make_shared<Memtable>())
+    , active_postings_(0)
+    , frozen_postings_(0)
+    , segments_(std::make_shared<const SegmentList>())
+    , stop_(false)
+    , pending_(false)
+    , busy_(false) {
+
+    if (config_.merge_fanout < 2) {
+        config_.merge_fanout = 2;
+    }
+
+    if (config_.background_merges) {
+        worker_ = std::thread(&SegmentedIndex::workerThread, this);
+    }
+}
+
+SegmentedIndex::~SegmentedIndex() {
+    {
+        std::lock_guard<std::mutex> lock(work_mutex_);
+        stop_ = true;
+    }
+
+    work_cv_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void SegmentedIndex::add(uint32_t hash, uint32_t content, uint32_t position) {
+    bool frozen = false;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+        (*active_)[hash].push_back({content, position});
+        if (++active_postings_ >= config_.memtable_max_postings) {
+            freezeLocked();
+            frozen = true;
+        }
+    }
+
+    total_postings_.fetch_add(1, std::memory_order_relaxed);
+
+    if (frozen) {
+        notifyWorker();
+    }
+}
+
+void SegmentedIndex::addFingerprint(uint32_t content, const std::vector<uint32_t>& hashes) {
+    bool frozen = false;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            (*active_)[hashes[i]].push_back({content, static_cast<uint32_t>(i)});
+        }
+        active_postings_ += hashes.size();
+        if (active_postings_ >= config_.memtable_max_postings) {
+            freezeLocked();
+            frozen = true;
+        }
+    }
+
+    total_postings_.fetch_add(hashes.size(), std::memory_order_relaxed);
+
+    if (frozen) {
+        notifyWorker();
+    }
+}
+
+void SegmentedIndex::addSegment(std::shared_ptr<const Segment> segment) {
+    if (!segment) {
+        return;
+    }
+
+    total_postings_.fetch_add(segment->numPostings(), std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        pinned_.insert(segment.get());
+        auto updated = std::make_shared<SegmentList>(*segments_);
+        updated->push_back(std::move(segment));
+        segments_ = std::move(updated);
+    }
+
+    notifyWorker();
+}
+
+void SegmentedIndex::lookup(uint32_t hash, std::vector<Posting>& out) const {
+    std::shared_ptr<const SegmentList> snapshot;
+
+    {
+        // Memtables and the segment snapshot are read under one shared lock
+        // so a concurrent flush is seen either before or after, never twice.
+        std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+
+        auto it = active_->find(hash);
+        if (it != active_->end()) {
+            out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+
+        for (const auto& memtable : frozen_) {
+            auto frozen_it = memtable->find(hash);
+            if (frozen_it != memtable->end()) {
+                out.insert(out.end(), frozen_it->second.begin(), frozen_it->second.end());
+            }
+        }
+
+        snapshot = segments();
+    }
+
+    for (const auto& segment : *snapshot) {
+        auto range = segment->lookup(hash);
+        out.insert(out.end(), range.begin(), range.end());
+    }
+}
+
+void SegmentedIndex::flush() {
+    {
+        std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+        freezeLocked();
+    }
+
+    notifyWorker();
+}
+
+void SegmentedIndex::waitForBackgroundWork() {
+    if (!config_.background_merges) {
+        runPendingWork();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(work_mutex_);
+    idle_cv_.wait(lock, [this] {
+        return stop_ || (!pending_ && !busy_);
+    });
+}
+
+std::shared_ptr<const SegmentedIndex::SegmentList> SegmentedIndex::segments() const {
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    return segments_;
+}
+
+SegmentedIndex::Snapshot SegmentedIndex::snapshot() const {
+    Snapshot result;
+
+    std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+    result.memtable.reserve(active_postings_ + frozen_postings_);
+
+    auto copy = [&result](const Memtable& memtable) {
+        for (const auto& [hash, postings] : memtable) {
+            for (const auto& posting : postings) {
+                result.memtable.push_back({hash, posting.content, posting.position});
+            }
+        }
+    };
+
+    copy(*active_);
+    for (const auto& memtable : frozen_) {
+        copy(*memtable);
+    }
+
+    result.segments = segments();
+    return result;
+}
+
+SegmentedIndex::Stats SegmentedIndex::getStats() const {
+    Stats stats = {0, 0, 0, 0, 0, 0, 0};
+
+    stats.total_postings = total_postings_.load(std::memory_order_relaxed);
+    stats.flushes = flushes_.load(std::memory_order_relaxed);
+    stats.merges = merges_.load(std::memory_order_relaxed);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+        stats.memtable_postings = active_postings_ + frozen_postings_;
+    }
+
+    auto snapshot = segments();
+    stats.num_segments = snapshot->size();
+    for (const auto& segment : *snapshot) {
+        stats.segment_bytes += segment->sizeBytes();
+        stats.filter_bytes += segment->filterBytes();
+    }
+
+    return stats;
+}
+
+void SegmentedIndex::freezeLocked() {
+    if (active_postings_ == 0) {
+        return;
+    }
+
+    frozen_.push_back(active_);
+    frozen_postings_ += active_postings_;
+    active_ = std::make_shared<Memtable>();
+    active_postings_ = 0;
+}
+
+bool SegmentedIndex::flushOne() {
+    std::shared_ptr<const Memtable> memtable;
+    {
+        std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+        if (frozen_.empty()) {
+            return false;
+        }
+        memtable = frozen_.front();
+    }
+
+    // Build the sorted run outside any lock readers take
+    std::vector<uint32_t> keys;
+    keys.reserve(memtable->size());
+    size_t num_postings = 0;
+    for (const auto& [hash, postings] : *memtable) {
+        keys.push_back(hash);
+        num_postings += postings.size();
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<PostingEntry> entries;
+    entries.reserve(num_postings);
+    for (uint32_t hash : keys) {
+        for (const auto& posting : memtable->at(hash)) {
+            entries.push_back({hash, posting.content, posting.position});
+        }
+    }
+
+    auto segment = Segment::build(entries, config_.directory, config_.filter_fpr);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+        {
+            std::lock_guard<std::mutex> segments_lock(segments_mutex_);
+            auto updated = std::make_shared<SegmentList>(*segments_);
+            updated->push_back(segment);
+            segments_ = std::move(updated);
+        }
+        frozen_.erase(frozen_.begin());
+        frozen_postings_ -= num_postings;
+    }
+
+    flushes_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool SegmentedIndex::mergeOne() {
+    // Only segments this index built take part in size tiers
+    std::map<size_t, SegmentList> tiers;
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        for (const auto& segment : *segments_) {
+            if (!pinned_.count(segment.get())) {
+                tiers[tierOf(*segment)].push_back(segment);
+            }
+        }
+    }
+
+    for (const auto& [tier, inputs] : tiers) {
+        if (inputs.size() < config_.merge_fanout) {
+            continue;
+        }
+
+        auto merged = Segment::merge(inputs, config_.directory, config_.filter_fpr);
+
+        {
+            std::lock_guard<std::mutex> lock(segments_mutex_);
+            auto updated = std::make_shared<SegmentList>();
+            for (const auto& segment : *segments_) {
+                if (std::find(inputs.begin(), inputs.end(), segment) == inputs.end()) {
+                    updated->push_back(segment);
+                }
+            }
+            updated->push_back(merged);
+            segments_ = std::move(updated);
+        }
+
+        merges_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void SegmentedIndex::runPendingWork() {
+    std::lock_guard<std::mutex> lock(maintenance_mutex_);
+
+    // Flushes first: frozen memtables are the slowest structures to probe
+    while (flushOne() || mergeOne()) {
+    }
+}
+
+size_t SegmentedIndex::tierOf(const Segment& segment) const {
+    size_t tier = 0;
+    size_t bound = config_.tier_base_postings;
+
+    while (segment.numPostings() > bound) {
+        bound *= config_.merge_fanout;
+        ++tier;
+    }
+
+    return tier;
+}
+
+void SegmentedIndex::workerThread() {
+    std::unique_lock<std::mutex> lock(work_mutex_);
+
+    while (true) {
+        work_cv_.wait(lock, [this] {
+            return stop_ || pending_;
+        });
+
+        if (stop_) {
+            idle_cv_.notify_all();
+            return;
+        }
+
+        pending_ = false;
+        busy_ = true;
+        lock.unlock();
+
+        runPendingWork();
+
+        lock.lock();
+        busy_ = false;
+        idle_cv_.notify_all();
+    }
+}
+
+void SegmentedIndex::notifyWorker() {
+    if (!config_.background_merges) {
+        runPendingWork();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(work_mutex_);
+        pending_ = true;
+    }
+
+    work_cv_.notify_one();
+}
+
+} // namespace index
+} // namespace vfs
@@ -0,0 +1,393 @@
+#include "index/tiered_store.h"
+#include <algorithm>
+#include <fstream>
+
+namespace vfs {
+namespace index {
+
+namespace {
+
+constexpr uint32_t FINGERPRINT_MAGIC = 0x46534656; // "VFSF"
+constexpr uint32_t FINGERPRINT_VERSION = 1;
+
+struct FingerprintFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_entries;
+    uint64_t slots_offset;
+    uint64_t data_offset;
+    uint64_t total_bytes;
+};
+
+} // namespace
+
+TieredStore::TieredStore(const Config& config)
+    : config_(config)
+    , fingerprint_slots_(nullptr)
+    , num_fingerprints_(0)
+    , fingerprint_data_(nullptr) {
+    if (config_.rebalance_interval > 0) {
+        maintenance_thread_ = std::thread(&TieredStore::maintenanceLoop, this);
+    }
+}
+
+TieredStore::~TieredStore() {
+    {
+        std::lock_guard<std::mutex> lock(maintenance_mutex_);
+        stopping_ = true;
+    }
+    maintenance_cv_.notify_one();
+
+    if (maintenance_thread_.joinable()) {
+        maintenance_thread_.join();
+    }
+}
+
+bool TieredStore::writeFingerprintFile(
+    const std::string& path,
+    const std::map<uint32_t, std::vector<uint32_t>>& fingerprints) {
+
+    std::vector<FingerprintSlot> slots;
+    slots.reserve(fingerprints.size());
+
+    uint64_t words = 0;
+    for (const auto& [content, hashes] : fingerprints) {
+        slots.push_back({content, static_cast<uint32_t>(hashes.size()), words});
+        words += hashes.size();
+    }
+
+    FingerprintFileHeader header;
+    header.magic = FINGERPRINT_MAGIC;
+    header.version = FINGERPRINT_VERSION;
+    header.num_entries = slots.size();
+    header.slots_offset = sizeof(FingerprintFileHeader);
+    header.data_offset = header.slots_offset + slots.size() * sizeof(FingerprintSlot);
+    header.total_bytes = header.data_offset + words * sizeof(uint32_t);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(slots.data()),
+              static_cast<std::streamsize>(slots.size() * sizeof(FingerprintSlot)));
+    for (const auto& [content, hashes] : fingerprints) {
+        out.write(reinterpret_cast<const char*>(hashes.data()),
+                  static_cast<std::streamsize>(hashes.size() * sizeof(uint32_t)));
+    }
+
+    return static_cast<bool>(out);
+}
+
+bool TieredStore::addSegmentFile(const std::string& path) {
+    // Mapped here rather than by Segment::open, to advise it on rebalance
+    std::shared_ptr<const utils::MappedFile> file = utils::MappedFile::open(path);
+    if (!file) {
+        return false;
+    }
+
+    auto segment = Segment::fromBuffer(file, file->data(), file->size());
+    if (!segment) {
+        return false;
+    }
+
+    auto tiered = std::make_unique<TieredSegment>();
+    tiered->file = std::move(file);
+    tiered->cold = std::move(segment);
+
+    std::unique_lock<std::shared_mutex> lock(tier_mutex_);
+    segments_.push_back(std::move(tiered));
+    return true;
+}
+
+bool TieredStore::openFingerprintFile(const std::string& path) {
+    auto file = utils::MappedFile::open(path);
+    if (!file || file->size() < sizeof(FingerprintFileHeader)) {
+        return false;
+    }
+
+    const auto* header = reinterpret_cast<const FingerprintFileHeader*>(file->data());
+    if (header->magic != FINGERPRINT_MAGIC || header->version != FINGERPRINT_VERSION ||
+        header->total_bytes > file->size() ||
+        header->num_entries > file->size() / sizeof(FingerprintSlot) ||
+        header->slots_offset > file->size() ||
+        header->slots_offset + header->num_entries * sizeof(FingerprintSlot) > header->data_offset ||
+        header->data_offset > header->total_bytes) {
+        return false;
+    }
+
+    size_t num_entries = static_cast<size_t>(header->num_entries);
+    const auto* slots = reinterpret_cast<const FingerprintSlot*>(file->data() + header->slots_offset);
+
+    // Views are handed out straight from the mapping, so every slot must
+    // lie inside the data section, in the content order lookups rely on
+    uint64_t data_words = (header->total_bytes - header->data_offset) / sizeof(uint32_t);
+    for (size_t i = 0; i < num_entries; ++i) {
+        if (slots[i].offset > data_words || slots[i].count > data_words - slots[i].offset ||
+            (i > 0 && slots[i].content <= slots[i - 1].content)) {
+            return false;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(tier_mutex_);
+    ++fingerprint_epoch_;
+    fingerprint_file_ = file;
+    fingerprint_slots_ = slots;
+    fingerprint_data_ = reinterpret_cast<const uint32_t*>(file->data() + header->data_offset);
+    num_fingerprints_ = num_entries;
+    hot_fingerprints_.assign(num_entries, nullptr);
+    fingerprint_accesses_.reset(new std::atomic<uint64_t>[num_entries]);
+    for (size_t i = 0; i < num_entries; ++i) {
+        fingerprint_accesses_[i].store(0, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+void TieredStore::lookup(uint32_t hash, std::vector<Posting>& out) {
+    {
+        std::shared_lock<std::shared_mutex> lock(tier_mutex_);
+
+        for (const auto& tiered : segments_) {
+            const Segment& segment = tiered->hot ? *tiered->hot : *tiered->cold;
+            auto range = segment.lookup(hash);
+            if (range.empty()) {
+                continue;
+            }
+
+            tiered->accesses.fetch_add(1, std::memory_order_relaxed);
+            (tiered->hot ? hot_hits_ : cold_hits_).fetch_add(1, std::memory_order_relaxed);
+            out.insert(out.end(), range.begin(), range.end());
+        }
+    }
+
+    recordAccess();
+}
+
+TieredStore::FingerprintView TieredStore::getFingerprint(uint32_t content) {
+    FingerprintView view = {nullptr, 0, nullptr};
+
+    {
+        std::shared_lock<std::shared_mutex> lock(tier_mutex_);
+
+        const FingerprintSlot* slots_end = fingerprint_slots_ + num_fingerprints_;
+        const FingerprintSlot* it = std::lower_bound(
+            fingerprint_slots_, slots_end, content,
+            [](const FingerprintSlot& slot, uint32_t value) {
+                return slot.content < value;
+            });
+
+        if (it == slots_end || it->content != content) {
+            return view;
+        }
+
+        size_t index = static_cast<size_t>(it - fingerprint_slots_);
+        fingerprint_accesses_[index].fetch_add(1, std::memory_order_relaxed);
+
+        if (const auto& hot = hot_fingerprints_[index]) {
+            view = {hot->data(), hot->size(), hot};
+            hot_hits_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            view = {fingerprint_data_ + it->offset, it->count, fingerprint_file_};
+            cold_hits_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    recordAccess();
+    return view;
+}
+
+void TieredStore::rebalance() {
+    std::lock_guard<std::mutex> lock(rebalance_mutex_);
+    rebalanceLocked();
+}
+
+void TieredStore::recordAccess() {
+    if (config_.rebalance_interval == 0) {
+        return;
+    }
+
+    // Only the access that reaches the interval signals; the count is
+    // reset when the rebalance starts
+    uint64_t count = accesses_since_rebalance_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (count != config_.rebalance_interval) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(maintenance_mutex_);
+        rebalance_due_ = true;
+    }
+    maintenance_cv_.notify_one();
+}
+
+void TieredStore::maintenanceLoop() {
+    std::unique_lock<std::mutex> lock(maintenance_mutex_);
+
+    while (true) {
+        maintenance_cv_.wait(lock, [this]() { return rebalance_due_ || stopping_; });
+        if (stopping_) {
+            return;
+        }
+        rebalance_due_ = false;
+
+        lock.unlock();
+        rebalance();
+        lock.lock();
+    }
+}
+
+void TieredStore::rebalanceLocked() {
+    accesses_since_rebalance_.store(0, std::memory_order_relaxed);
+
+    struct Candidate {
+        double heat;        // Accesses per byte
+        size_t bytes;
+        bool is_segment;
+        size_t index;
+    };
+
+    std::vector<Candidate> candidates;
+    std::vector<std::shared_ptr<const Segment>> segment_copies;
+    std::vector<std::shared_ptr<const std::vector<uint32_t>>> fingerprint_copies;
+    size_t used = 0;
+    uint64_t epoch;
+
+    // Plan and copy against one view of the tiers. Readers share the lock;
+    // a fingerprint file opened before the apply below voids the plan.
+    {
+        std::shared_lock<std::shared_mutex> lock(tier_mutex_);
+        epoch = fingerprint_epoch_;
+
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            uint64_t accesses = segments_[i]->accesses.load(std::memory_order_relaxed);
+            size_t bytes = segments_[i]->cold->sizeBytes();
+            if (accesses > 0) {
+                candidates.push_back({static_cast<double>(accesses) / bytes, bytes, true, i});
+            }
+        }
+
+        for (size_t i = 0; i < num_fingerprints_; ++i) {
+            uint64_t accesses = fingerprint_accesses_[i].load(std::memory_order_relaxed);
+            size_t bytes = std::max<size_t>(fingerprint_slots_[i].count * sizeof(uint32_t), 1);
+            if (accesses > 0) {
+                candidates.push_back({static_cast<double>(accesses) / bytes, bytes, false, i});
+            }
+        }
+
+        // Greedily fill the RAM budget with the hottest bytes
+        std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) {
+                return a.heat > b.heat;
+            });
+
+        segment_copies.resize(segments_.size());
+        fingerprint_copies.resize(num_fingerprints_);
+
+        size_t budget = config_.hot_budget_bytes;
+        for (const auto& candidate : candidates) {
+            if (used + candidate.bytes > budget) {
+                continue;
+            }
+            used += candidate.bytes;
+
+            size_t i = candidate.index;
+            if (candidate.is_segment) {
+                segment_copies[i] = segments_[i]->hot ? segments_[i]->hot : segments_[i]->cold->copy();
+            } else if (hot_fingerprints_[i]) {
+                fingerprint_copies[i] = hot_fingerprints_[i];
+            } else {
+                const uint32_t* first = fingerprint_data_ + fingerprint_slots_[i].offset;
+                fingerprint_copies[i] = std::make_shared<const std::vector<uint32_t>>(
+                    first, first + fingerprint_slots_[i].count);
+            }
+        }
+    }
+
+    // Mappings whose segment changed tier, advised once the lock is dropped
+    std::vector<std::shared_ptr<const utils::MappedFile>> promoted_files;
+    std::vector<std::shared_ptr<const utils::MappedFile>> demoted_files;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(tier_mutex_);
+        if (fingerprint_epoch_ != epoch) {
+            return;
+        }
+
+        // Segments are only ever appended, so the planned ones are unchanged
+        for (size_t i = 0; i < segment_copies.size(); ++i) {
+            auto& tiered = *segments_[i];
+            if (!tiered.hot && segment_copies[i]) {
+                promotions_.fetch_add(1, std::memory_order_relaxed);
+                promoted_files.push_back(tiered.file);
+            } else if (tiered.hot && !segment_copies[i]) {
+                demotions_.fetch_add(1, std::memory_order_relaxed);
+                demoted_files.push_back(tiered.file);
+            }
+            tiered.hot = std::move(segment_copies[i]);
+
+            uint64_t accesses = tiered.accesses.load(std::memory_order_relaxed);
+            tiered.accesses.store(static_cast<uint64_t>(accesses * config_.counter_decay),
+                                  std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < fingerprint_copies.size(); ++i) {
+            if (!hot_fingerprints_[i] && fingerprint_copies[i]) {
+                promotions_.fetch_add(1, std::memory_order_relaxed);
+            } else if (hot_fingerprints_[i] && !fingerprint_copies[i]) {
+                demotions_.fetch_add(1, std::memory_order_relaxed);
+            }
+            hot_fingerprints_[i] = std::move(fingerprint_copies[i]);
+
+            uint64_t accesses = fingerprint_accesses_[i].load(std::memory_order_relaxed);
+            fingerprint_accesses_[i].store(static_cast<uint64_t>(accesses * config_.counter_decay),
+                                           std::memory_order_relaxed);
+        }
+    }
+
+    // A promoted segment is served from RAM, so its mapped pages can go;
+    // a demoted one is read ahead before lookups fault it in page by page
+    for (const auto& file : promoted_files) {
+        file->adviseDontNeed();
+    }
+    for (const auto& file : demoted_files) {
+        file->adviseWillNeed();
+    }
+
+    hot_bytes_.store(used, std::memory_order_relaxed);
+}
+
+TieredStore::Stats TieredStore::getStats() const {
+    Stats stats = {0, 0, 0, 0, 0, 0, 0, 0};
+
+    stats.hot_bytes = hot_bytes_.load(std::memory_order_relaxed);
+    stats.hot_hits = hot_hits_.load(std::memory_order_relaxed);
+    stats.cold_hits = cold_hits_.load(std::memory_order_relaxed);
+    stats.promotions = promotions_.load(std::memory_order_relaxed);
+    stats.demotions = demotions_.load(std::memory_order_relaxed);
+
+    std::shared_lock<std::shared_mutex> lock(tier_mutex_);
+
+    for (const auto& tiered : segments_) {
+        stats.cold_bytes += tiered->cold->sizeBytes();
+        if (tiered->hot) {
+            ++stats.hot_segments;
+        }
+    }
+
+    if (fingerprint_file_) {
+        stats.cold_bytes += fingerprint_file_->size();
+    }
+
+    for (const auto& hot : hot_fingerprints_) {
+        if (hot) {
+            ++stats.hot_fingerprints;
+        }
+    }
+
+    return stats;
+}
+
+} // namespace index
+} // namespace vfs
@@ -1,22 +1,56 @@
 #include "matcher/matcher_service.h"
 #include <chrono>
 #include <algorithm>
-#include <numeric>
+#include <cstring>
 
 namespace vfs {
 namespace matcher {
 
-    MatcherService::MatcherService(
-        std::shared_ptr<database::DatabaseManager> db_manager,
-        std::shared_ptr<monitoring::MetricsCollector> metrics,
-        const Config& config)
-        : db_manager_(db_manager)
-        , metrics_(metrics)
-        , thread_pool_(std::make_unique<utils::ThreadPool>(config.num_threads))
-        , config_(config) {
-    }
+namespace {
+
+// Distinct hashes looked up between deadline checks of a shared batch
+constexpr size_t DEADLINE_CHECK_INTERVAL = 64;
+
+constexpr uint64_t K_MUL1 = 0x9E3779B97F4A7C15ull;
+constexpr uint64_t K_MUL2 = 0xC2B2AE3D27D4EB4Full;
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * @brief splitmix64 finaliser: every input bit affects every output bit
+ */
+inline uint64_t finalize64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
 
-MatcherService::~MatcherService() = default;
+} // namespace
+
+MatcherService::MatcherService(
+    std::shared_ptr<database::DatabaseManager> db_manager,
+    std::shared_ptr<monitoring::MetricsCollector> metrics,
+    const Config& config)
+    : db_manager_(db_manager)
+    , metrics_(metrics)
+    , thread_pool_(std::make_unique<utils::ThreadPool>(config.num_threads))
+    , config_(config) {
+
+    ResultCache::Config cache_config;
+    cache_config.capacity = config.cache_size;
+    cache_config.max_bytes = config.cache_max_bytes;
+    cache_config.ttl = std::chrono::milliseconds(config.cache_ttl_ms);
+    cache_config.num_shards = config.cache_shards;
+    cache_config.near_duplicate_similarity = config.near_duplicate_similarity;
+    cache_ = std::make_unique<ResultCache>(cache_config);
+}
+
+MatcherService::~MatcherService() {
+    // Drain the workers while the queues and cache they use still exist
+    thread_pool_.reset();
+}
 
 MatcherService::MatchResponse 
 MatcherService::match(const MatchRequest& request) {
@@ -24,20 +58,173 @@ MatcherService::match(const MatchRequest& request) {
 }
 
 std::future<MatcherService::MatchResponse> 
-MatcherService::matchAsync(const MatchRequest& request) {
-    return thread_pool_->submit([this, request]() {
-        return processMatch(request);
-    });
+MatcherService::matchAsync(MatchRequest request) {
+    auto wait_until = std::chrono::steady_clock::now();
+    if (config_.admission_policy == AdmissionPolicy::Block) {
+        wait_until += std::chrono::milliseconds(config_.admission_timeout_ms);
+        wait_until = std::min(wait_until, request.deadline);
+    }
+    
+    if (!admit(wait_until)) {
+        rejected_requests_.fetch_add(1, std::memory_order_relaxed);
+        metrics_->incrementCounter("match_rejected");
+        
+        MatchResponse response;
+        response.request_id = request.request_id;
+        response.success = false;
+        response.partial = false;
+        response.processing_time_us = 0;
+        response.error_message = "Rejected: match queue is full";
+        
+        std::promise<MatchResponse> rejected;
+        rejected.set_value(std::move(response));
+        return rejected.get_future();
+    }
+    
+    return enqueue(std::move(request));
+}
+
+std::future<MatcherService::MatchResponse> 
+MatcherService::enqueue(MatchRequest request) {
+    QueuedRequest queued;
+    queued.request = std::move(request);
+    auto future = queued.promise.get_future();
+    schedule(std::move(queued));
+    return future;
+}
+
+void MatcherService::schedule(QueuedRequest queued) {
+    size_t priority = static_cast<size_t>(queued.request.priority);
+    queued.enqueued = std::chrono::steady_clock::now();
+    
+    {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        run_queues_[priority].push_back(std::move(queued));
+    }
+    
+    thread_pool_->submit([this]() { runNext(); });
+}
+
+void MatcherService::runNext() {
+    QueuedRequest next;
+    
+    {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        auto now = std::chrono::steady_clock::now();
+        auto aging = std::chrono::milliseconds(config_.priority_aging_ms);
+        
+        // Anti-starvation: the oldest request past the aging limit goes first
+        size_t chosen = NUM_PRIORITIES;
+        for (size_t p = 0; p < NUM_PRIORITIES; ++p) {
+            const auto& queue = run_queues_[p];
+            if (!queue.empty() && now - queue.front().enqueued >= aging &&
+                (chosen == NUM_PRIORITIES ||
+                 queue.front().enqueued < run_queues_[chosen].front().enqueued)) {
+                chosen = p;
+            }
+        }
+        
+        // Otherwise strict priority
+        for (size_t p = 0; p < NUM_PRIORITIES && chosen == NUM_PRIORITIES; ++p) {
+            if (!run_queues_[p].empty()) {
+                chosen = p;
+            }
+        }
+        
+        // One task per queued request, so this only guards against misuse
+        if (chosen == NUM_PRIORITIES) {
+            return;
+        }
+        
+        next = std::move(run_queues_[chosen].front());
+        run_queues_[chosen].pop_front();
+    }
+    
+    release();
+    
+    static const char* const wait_metrics[NUM_PRIORITIES] = {
+        "match_queue_wait_live", "match_queue_wait_normal", "match_queue_wait_batch"
+    };
+    metrics_->recordLatency(
+        wait_metrics[static_cast<size_t>(next.request.priority)],
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - next.enqueued).count());
+    
+    if (next.task) {
+        next.task();
+        return;
+    }
+    
+    try {
+        next.promise.set_value(processMatch(next.request));
+    } catch (...) {
+        next.promise.set_exception(std::current_exception());
+    }
+}
+
+bool MatcherService::admit(std::chrono::steady_clock::time_point wait_until) {
+    if (config_.max_queued_requests == 0) {
+        queued_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    
+    std::unique_lock<std::mutex> lock(admission_mutex_);
+    auto has_room = [this]() {
+        return queued_.load(std::memory_order_relaxed) < config_.max_queued_requests;
+    };
+    
+    if (wait_until == std::chrono::steady_clock::time_point::max()) {
+        admission_cv_.wait(lock, has_room);
+    } else if (!admission_cv_.wait_until(lock, wait_until, has_room)) {
+        return false;
+    }
+    
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void MatcherService::release() {
+    if (config_.max_queued_requests == 0) {
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(admission_mutex_);
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    admission_cv_.notify_one();
 }
 
 std::vector<MatcherService::MatchResponse> 
 MatcherService::matchBatch(const std::vector<MatchRequest>& requests) {
+    if (config_.shared_batch_lookups && requests.size() > 1 && db_manager_->hasIndex()) {
+        std::promise<std::vector<MatchResponse>> batch;
+        auto future = batch.get_future();
+        
+        // Waits for a slot and its turn like any Batch-class request
+        QueuedRequest queued;
+        queued.request.priority = Priority::Batch;
+        queued.task = [this, &requests, &batch]() {
+            try {
+                batch.set_value(matchBatchShared(requests));
+            } catch (...) {
+                batch.set_exception(std::current_exception());
+            }
+        };
+        
+        admit(std::chrono::steady_clock::time_point::max());
+        schedule(std::move(queued));
+        return future.get();
+    }
+    
     std::vector<std::future<MatchResponse>> futures;
     futures.reserve(requests.size());
 
-    // Submit all requests to thread pool
+    // Submit all requests to thread pool, waiting for queue slots as needed
     for (const auto& request : requests) {
-        futures.push_back(matchAsync(request));
+        admit(std::chrono::steady_clock::time_point::max());
+        futures.push_back(enqueue(request));
     }
 
     // Collect results
@@ -51,6 +238,254 @@ MatcherService::matchBatch(const std::vector<MatchRequest>& requests) {
     return responses;
 }
 
+std::vector<MatcherService::MatchResponse> 
+MatcherService::matchBatchShared(const std::vector<MatchRequest>& requests) {
+    auto start_time = std::chrono::steady_clock::now();
+    metrics_->incrementCounter("match_shared_batches");
+    
+    std::vector<MatchResponse> responses(requests.size());
+    
+    // Cache misses still to query, one per distinct cache key
+    struct Pending {
+        size_t request;
+        double min_sim;
+        size_t max_res;
+        ResultCache::Key cache_key;
+        uint64_t generation;
+        std::optional<ResultCache::Signature> signature;
+        database::DatabaseManager::Deadline deadline;
+        std::vector<size_t> duplicates;   // Identical requests answered alike
+        database::DatabaseManager::VoteTable votes;
+        bool out_of_time = false;         // Deadline passed during the lookups
+        bool failed = false;
+    };
+    std::vector<Pending> pending;
+    std::unordered_map<ResultCache::Key, size_t> pending_by_key;
+    
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const auto& request = requests[i];
+        auto& response = responses[i];
+        response.request_id = request.request_id;
+        response.success = false;
+        response.partial = false;
+        response.processing_time_us = 0;
+        
+        total_requests_.fetch_add(1, std::memory_order_relaxed);
+        
+        if (request.deadline != database::DatabaseManager::Deadline::max() &&
+            start_time >= request.deadline) {
+            expired_requests_.fetch_add(1, std::memory_order_relaxed);
+            metrics_->incrementCounter("match_deadline_expired");
+            response.error_message = "Deadline expired before processing";
+            continue;
+        }
+        
+        Pending query;
+        query.request = i;
+        query.deadline = request.deadline;
+        query.min_sim = request.min_similarity > 0 
+                      ? request.min_similarity 
+                      : config_.default_min_similarity;
+        query.max_res = request.max_results > 0 
+                      ? request.max_results 
+                      : config_.default_max_results;
+        query.cache_key = generateCacheKey(request.fingerprint, query.min_sim, query.max_res);
+        query.generation = config_.invalidate_cache_on_ingest
+                         ? db_manager_->getGeneration()
+                         : 0;
+        
+        if (config_.enable_caching) {
+            auto cached_results = checkCache(query.cache_key, query.generation);
+            if (!cached_results && cache_->nearDuplicatesEnabled()) {
+                query.signature = ResultCache::signature(
+                    request.fingerprint.hash_values, paramsDigest(query.min_sim, query.max_res));
+                cached_results = cache_->lookupSimilar(
+                    *query.signature, request.fingerprint.hash_values, query.generation);
+                if (cached_results) {
+                    cache_near_hits_.fetch_add(1, std::memory_order_relaxed);
+                    metrics_->incrementCounter("match_cache_near_hits");
+                }
+            }
+            if (cached_results) {
+                // Counted as processMatch counts a cache hit
+                cache_hits_.fetch_add(1, std::memory_order_relaxed);
+                response.matches = std::move(cached_results);
+                response.success = true;
+                response.processing_time_us = std::chrono::duration_cast<
+                    std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+                metrics_->recordLatency("match_cached", response.processing_time_us);
+                continue;
+            }
+            cache_misses_.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        auto [it, inserted] = pending_by_key.emplace(query.cache_key, pending.size());
+        if (inserted) {
+            pending.push_back(std::move(query));
+        } else {
+            pending[it->second].duplicates.push_back(i);
+            coalesced_requests_.fetch_add(1, std::memory_order_relaxed);
+            metrics_->incrementCounter("match_coalesced_hits");
+        }
+    }
+    
+    // Every query hash, grouped by value so each posting list is read once
+    struct Occurrence {
+        uint32_t hash;
+        uint32_t query;
+        uint32_t position;
+    };
+    std::vector<Occurrence> occurrences;
+    for (size_t q = 0; q < pending.size(); ++q) {
+        const auto& hashes = requests[pending[q].request].fingerprint.hash_values;
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            occurrences.push_back({hashes[i], static_cast<uint32_t>(q), static_cast<uint32_t>(i)});
+        }
+    }
+    std::sort(occurrences.begin(), occurrences.end(),
+        [](const Occurrence& a, const Occurrence& b) {
+            return a.hash < b.hash;
+        });
+    
+    // First occurrence of each distinct hash, plus an end marker
+    std::vector<size_t> groups;
+    for (size_t o = 0; o < occurrences.size(); ++o) {
+        if (o == 0 || occurrences[o].hash != occurrences[o - 1].hash) {
+            groups.push_back(o);
+        }
+    }
+    size_t num_groups = groups.size();
+    groups.push_back(occurrences.size());
+    
+    // Chunks of distinct hashes are looked up across the pool; each chunk
+    // votes locally and merges into the queries once
+    size_t chunk = std::max<size_t>(config_.parallel_query_chunk, 1);
+    size_t num_chunks = (num_groups + chunk - 1) / chunk;
+    std::mutex votes_mutex;
+    
+    try {
+        monitoring::MetricsCollector::Timer timer(metrics_.get(), "match_batch_lookup");
+        
+        parallelFor(num_chunks, [&](size_t c) {
+            size_t first = c * chunk;
+            size_t last = std::min(first + chunk, num_groups);
+            
+            std::unordered_map<uint32_t, database::DatabaseManager::VoteTable> local;
+            std::vector<uint32_t> late;    // Queries whose deadline passed here
+            std::vector<index::Posting> postings;
+            auto now = std::chrono::steady_clock::now();
+            
+            for (size_t g = first; g < last; ++g) {
+                if ((g - first) % DEADLINE_CHECK_INTERVAL == 0) {
+                    now = std::chrono::steady_clock::now();
+                }
+                size_t begin = groups[g];
+                size_t end = groups[g + 1];
+                size_t limit = db_manager_->lookupPostings(occurrences[begin].hash, postings);
+                
+                for (size_t o = begin; o < end; ++o) {
+                    uint32_t q = occurrences[o].query;
+                    if (now >= pending[q].deadline) {
+                        late.push_back(q);
+                        continue;
+                    }
+                    auto& votes = local[q];
+                    for (size_t p = 0; p < limit; ++p) {
+                        int32_t offset = static_cast<int32_t>(postings[p].position) -
+                                         static_cast<int32_t>(occurrences[o].position);
+                        ++votes[postings[p].content][offset];
+                    }
+                }
+            }
+            
+            std::lock_guard<std::mutex> lock(votes_mutex);
+            for (auto& [q, votes] : local) {
+                if (pending[q].votes.empty()) {
+                    pending[q].votes = std::move(votes);
+                } else {
+                    database::DatabaseManager::mergeVotes(pending[q].votes, votes);
+                }
+            }
+            for (uint32_t q : late) {
+                pending[q].out_of_time = true;
+            }
+        });
+    } catch (const std::exception& e) {
+        for (auto& query : pending) {
+            query.failed = true;
+            query.votes.clear();
+            responses[query.request].error_message = e.what();
+        }
+        metrics_->incrementCounter("match_errors");
+    }
+    
+    if (!occurrences.empty()) {
+        metrics_->recordGauge("match_batch_lookup_ratio",
+                              static_cast<double>(num_groups) / occurrences.size());
+    }
+    
+    // Each query is ranked on its own, also across the pool
+    parallelFor(pending.size(), [&](size_t q) {
+        auto& query = pending[q];
+        const auto& request = requests[query.request];
+        auto& response = responses[query.request];
+        
+        // A failed lookup pass left its error message; nothing to rank
+        if (!query.failed) {
+            try {
+                response.matches = SharedResults(db_manager_->rankVotes(
+                    request.fingerprint, query.votes, query.min_sim, query.max_res,
+                    request.deadline, &response.partial));
+                response.partial = response.partial || query.out_of_time;
+                
+                if (config_.enable_caching && !response.partial && !response.matches.empty()) {
+                    updateCache(query.cache_key, response.matches, query.generation,
+                                query.signature ? &*query.signature : nullptr,
+                                request.fingerprint.hash_values);
+                }
+                response.success = true;
+            } catch (const std::exception& e) {
+                response.error_message = e.what();
+                metrics_->incrementCounter("match_errors");
+            }
+        }
+        
+        database::DatabaseManager::VoteTable().swap(query.votes);
+        for (size_t d : query.duplicates) {
+            responses[d].matches = response.matches;
+            responses[d].partial = response.partial;
+            responses[d].success = response.success;
+            responses[d].error_message = response.error_message;
+        }
+    });
+    
+    auto end_time = std::chrono::steady_clock::now();
+    uint64_t elapsed_us = std::chrono::duration_cast<
+        std::chrono::microseconds>(end_time - start_time).count();
+    
+    // Queried requests share the batch's time
+    for (const auto& query : pending) {
+        std::vector<size_t> answered = query.duplicates;
+        answered.push_back(query.request);
+        for (size_t i : answered) {
+            auto& response = responses[i];
+            if (response.success) {
+                successful_matches_.fetch_add(1, std::memory_order_relaxed);
+                if (response.partial) {
+                    partial_matches_.fetch_add(1, std::memory_order_relaxed);
+                    metrics_->incrementCounter("match_partial");
+                }
+            }
+            response.processing_time_us = elapsed_us;
+            
+            latencies_.record(elapsed_us);
+            metrics_->recordLatency("match_total", elapsed_us);
+        }
+    }
+    
+    return responses;
+}
+
 MatcherService::MatchResponse 
 MatcherService::processMatch(const MatchRequest& request) {
     auto start_time = std::chrono::steady_clock::now();
@@ -58,19 +493,57 @@ MatcherService::processMatch(const MatchRequest& request) {
     MatchResponse response;
     response.request_id = request.request_id;
     response.success = false;
+    response.partial = false;
 
     total_requests_.fetch_add(1, std::memory_order_relaxed);
 
+    // The caller has given up already; do not spend a worker on it
+    if (request.deadline != database::DatabaseManager::Deadline::max() &&
+        start_time >= request.deadline) {
+        expired_requests_.fetch_add(1, std::memory_order_relaxed);
+        metrics_->incrementCounter("match_deadline_expired");
+        response.error_message = "Deadline expired before processing";
+        response.processing_time_us = 0;
+        return response;
+    }
+
     try {
+        double min_sim = request.min_similarity > 0 
+                        ? request.min_similarity 
+                        : config_.default_min_similarity;
+        
+        size_t max_res = request.max_results > 0 
+                        ? request.max_results 
+                        : config_.default_max_results;
+
         // Generate cache key
-        std::string cache_key = generateCacheKey(request.fingerprint);
+        ResultCache::Key cache_key = generateCacheKey(request.fingerprint, min_sim, max_res);
+
+        std::optional<ResultCache::Signature> signature;
+
+        // Read before querying: a write landing after this makes the
+        // results we cache stale, never the other way round
+        uint64_t generation = config_.invalidate_cache_on_ingest
+                            ? db_manager_->getGeneration()
+                            : 0;
 
         // Check cache
         if (config_.enable_caching) {
-            auto cached_results = checkCache(cache_key);
+            auto cached_results = checkCache(cache_key, generation);
+            if (!cached_results && cache_->nearDuplicatesEnabled()) {
+                // Fall back to a verified near-duplicate of this query
+                signature = ResultCache::signature(
+                    request.fingerprint.hash_values, paramsDigest(min_sim, max_res));
+                cached_results = cache_->lookupSimilar(
+                    *signature, request.fingerprint.hash_values, generation);
+                if (cached_results) {
+                    cache_near_hits_.fetch_add(1, std::memory_order_relaxed);
+                    metrics_->incrementCounter("match_cache_near_hits");
+                }
+            }
             if (cached_results) {
                 cache_hits_.fetch_add(1, std::memory_order_relaxed);
-                response.matches = *cached_results;
+                response.matches = std::move(cached_results);
                 response.success = true;
                 
                 auto end_time = std::chrono::steady_clock::now();
@@ -83,26 +556,76 @@ MatcherService::processMatch(const MatchRequest& request) {
             cache_misses_.fetch_add(1, std::memory_order_relaxed);
         }
 
-        // Query database
-        monitoring::MetricsCollector::Timer timer(metrics_.get(), "match_db_query");
+        // Coalesce with an identical query already in flight, unless it
+        // started before a write this request must observe or may give
+        // up sooner than this request would
+        std::promise<FlightResult> flight;
+        std::optional<std::shared_future<FlightResult>> joined;
+        bool leading = false;
         
-        double min_sim = request.min_similarity > 0 
-                        ? request.min_similarity 
-                        : config_.default_min_similarity;
+        if (config_.enable_coalescing) {
+            std::lock_guard<std::mutex> lock(inflight_mutex_);
+            auto it = inflight_.find(cache_key);
+            if (it == inflight_.end()) {
+                inflight_.emplace(cache_key, InFlight{
+                    flight.get_future().share(), generation, request.deadline});
+                leading = true;
+            } else if (it->second.generation >= generation &&
+                       it->second.deadline >= request.deadline) {
+                joined = it->second.results;
+            }
+        }
         
-        size_t max_res = request.max_results > 0 
-                        ? request.max_results 
-                        : config_.default_max_results;
-
-        response.matches = db_manager_->findMatches(
-            request.fingerprint,
-            min_sim,
-            max_res
-        );
-
-        // Update cache
-        if (config_.enable_caching && !response.matches.empty()) {
-            updateCache(cache_key, response.matches);
+        auto endFlight = [this, cache_key]() {
+            std::lock_guard<std::mutex> lock(inflight_mutex_);
+            inflight_.erase(cache_key);
+        };
+        
+        if (joined) {
+            bool ready = request.deadline == database::DatabaseManager::Deadline::max()
+                       ? (joined->wait(), true)
+                       : joined->wait_until(request.deadline) == std::future_status::ready;
+            if (ready) {
+                // Rethrows the leader's error, if any
+                const FlightResult& shared = joined->get();
+                response.matches = shared.matches;
+                response.partial = shared.partial;
+            } else {
+                response.partial = true;
+            }
+            coalesced_requests_.fetch_add(1, std::memory_order_relaxed);
+            metrics_->incrementCounter("match_coalesced_hits");
+        } else {
+            try {
+                // Query database
+                monitoring::MetricsCollector::Timer timer(metrics_.get(), "match_db_query");
+                
+                response.matches = SharedResults(
+                    queryDatabase(request, min_sim, max_res, &response.partial));
+            } catch (...) {
+                if (leading) {
+                    flight.set_exception(std::current_exception());
+                    endFlight();
+                }
+                throw;
+            }
+            
+            // Update cache before retiring the flight, so later duplicates
+            // hit it; partial results are never cached
+            if (config_.enable_caching && !response.partial && !response.matches.empty()) {
+                updateCache(cache_key, response.matches, generation,
+                            signature ? &*signature : nullptr, request.fingerprint.hash_values);
+            }
+            
+            if (leading) {
+                flight.set_value(FlightResult{response.matches, response.partial});
+                endFlight();
+            }
+        }
+        
+        if (response.partial) {
+            partial_matches_.fetch_add(1, std::memory_order_relaxed);
+            metrics_->incrementCounter("match_partial");
         }
 
         response.success = true;
@@ -119,62 +642,206 @@ MatcherService::processMatch(const MatchRequest& request) {
         std::chrono::microseconds>(end_time - start_time).count();
 
     // Record latency
-    {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        latencies_.push_back(response.processing_time_us);
-    }
+    latencies_.record(response.processing_time_us);
 
     metrics_->recordLatency("match_total", response.processing_time_us);
     return response;
 }
 
-std::optional<std::vector<database::DatabaseManager::MatchResult>>
-MatcherService::checkCache(const std::string& cache_key) {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
+std::vector<database::DatabaseManager::MatchResult>
+MatcherService::queryDatabase(
+    const MatchRequest& request,
+    double min_similarity,
+    size_t max_results,
+    bool* partial) {
+    
+    const auto& hashes = request.fingerprint.hash_values;
+    size_t chunk = std::max<size_t>(config_.parallel_query_chunk, 1);
+    size_t num_chunks = (hashes.size() + chunk - 1) / chunk;
+    
+    // Posting lookups are lock-free; the SQL path has one connection
+    if (config_.parallel_query_threshold == 0 ||
+        hashes.size() < config_.parallel_query_threshold ||
+        config_.num_threads < 2 || num_chunks < 2 ||
+        !db_manager_->hasIndex()) {
+        return db_manager_->findMatches(
+            request.fingerprint, min_similarity, max_results, request.deadline, partial);
+    }
+    
+    metrics_->incrementCounter("match_parallel_queries");
     
-    auto it = cache_.find(cache_key);
-    if (it != cache_.end()) {
-        // Update LRU
-        cache_lru_.remove(cache_key);
-        cache_lru_.push_front(cache_key);
+    // Shared with helpers that may start after the query has finished;
+    // those find no chunk left and never touch the hashes
+    struct Job {
+        const std::vector<uint32_t>* hashes;
+        size_t chunk;
+        size_t num_chunks;
+        database::DatabaseManager::Deadline deadline;
+        std::atomic<size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        size_t done = 0;
+        bool complete = true;
+        database::DatabaseManager::VoteTable votes;
+    };
+    auto job = std::make_shared<Job>();
+    job->hashes = &hashes;
+    job->chunk = chunk;
+    job->num_chunks = num_chunks;
+    job->deadline = request.deadline;
+    
+    auto work = [db = db_manager_.get()](Job& job) {
+        database::DatabaseManager::VoteTable local;
+        size_t claimed = 0;
+        bool complete = true;
+        for (size_t c = job.next.fetch_add(1); c < job.num_chunks; c = job.next.fetch_add(1)) {
+            size_t begin = c * job.chunk;
+            size_t end = std::min(begin + job.chunk, job.hashes->size());
+            complete = db->voteRange(*job.hashes, begin, end, local, job.deadline) && complete;
+            ++claimed;
+        }
+        if (claimed == 0) {
+            return;
+        }
         
-        return it->second.results;
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (job.votes.empty()) {
+                job.votes = std::move(local);
+            } else {
+                database::DatabaseManager::mergeVotes(job.votes, local);
+            }
+            job.complete = job.complete && complete;
+            job.done += claimed;
+        }
+        job.done_cv.notify_one();
+    };
+    
+    size_t helpers = std::min(config_.num_threads - 1, num_chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        thread_pool_->submit([job, work]() { work(*job); });
     }
+    work(*job);
     
-    return std::nullopt;
+    database::DatabaseManager::VoteTable votes;
+    bool complete;
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->done_cv.wait(lock, [&job]() { return job->done == job->num_chunks; });
+        votes = std::move(job->votes);
+        complete = job->complete;
+    }
+    
+    auto results = db_manager_->rankVotes(
+        request.fingerprint, votes, min_similarity, max_results, request.deadline, partial);
+    if (partial && !complete) {
+        *partial = true;
+    }
+    return results;
+}
+
+void MatcherService::parallelFor(size_t count, std::function<void(size_t)> body) {
+    // Shared with helpers that may start after the caller has returned;
+    // those find no item left and never call the body
+    struct Job {
+        std::function<void(size_t)> body;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        size_t done = 0;
+        std::exception_ptr error;
+    };
+    auto job = std::make_shared<Job>();
+    job->body = std::move(body);
+    job->count = count;
+    
+    auto work = [](Job& job) {
+        size_t claimed = 0;
+        std::exception_ptr error;
+        for (size_t i = job.next.fetch_add(1); i < job.count; i = job.next.fetch_add(1)) {
+            try {
+                job.body(i);
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            ++claimed;
+        }
+        if (claimed == 0) {
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.done += claimed;
+            if (error && !job.error) {
+                job.error = error;
+            }
+        }
+        job.done_cv.notify_one();
+    };
+    
+    size_t helpers = count > 1 && config_.num_threads > 1
+                   ? std::min(config_.num_threads - 1, count - 1)
+                   : 0;
+    for (size_t i = 0; i < helpers; ++i) {
+        thread_pool_->submit([job, work]() { work(*job); });
+    }
+    work(*job);
+    
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done_cv.wait(lock, [&job]() { return job->done == job->count; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+ResultCache::Results MatcherService::checkCache(ResultCache::Key cache_key, uint64_t generation) {
+    return cache_->lookup(cache_key, generation);
 }
 
 void MatcherService::updateCache(
-    const std::string& cache_key,
-    const std::vector<database::DatabaseManager::MatchResult>& results) {
+    ResultCache::Key cache_key,
+    const SharedResults& results,
+    uint64_t generation,
+    const ResultCache::Signature* signature,
+    const std::vector<uint32_t>& query) {
+    cache_->insert(cache_key, results.shared(), generation, signature, &query);
+}
+
+ResultCache::Key MatcherService::generateCacheKey(
+    const core::FingerprintGenerator::Fingerprint& fingerprint,
+    double min_similarity,
+    size_t max_results) const {
     
-    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const auto& hashes = fingerprint.hash_values;
+    uint64_t h = 0x243F6A8885A308D3ull ^ (hashes.size() * K_MUL1);
     
-    // Check if cache is full
-    if (cache_.size() >= config_.cache_size) {
-        // Remove least recently used
-        std::string lru_key = cache_lru_.back();
-        cache_lru_.pop_back();
-        cache_.erase(lru_key);
+    // Two sub-fingerprints per 64-bit word
+    size_t i = 0;
+    for (; i + 2 <= hashes.size(); i += 2) {
+        uint64_t word = hashes[i] | (static_cast<uint64_t>(hashes[i + 1]) << 32);
+        h = rotl64(h ^ (word * K_MUL1), 31) * K_MUL2;
+    }
+    if (i < hashes.size()) {
+        h = rotl64(h ^ (hashes[i] * K_MUL1), 31) * K_MUL2;
     }
     
-    // Add to cache
-    CacheEntry entry;
-    entry.results = results;
-    entry.timestamp = std::chrono::steady_clock::now();
+    // Results depend on the parameters as much as on the query
+    h = rotl64(h ^ (paramsDigest(min_similarity, max_results) * K_MUL1), 31) * K_MUL2;
     
-    cache_[cache_key] = entry;
-    cache_lru_.push_front(cache_key);
+    return finalize64(h);
 }
 
-std::string MatcherService::generateCacheKey(
-    const core::FingerprintGenerator::Fingerprint& fingerprint) const {
+uint64_t MatcherService::paramsDigest(double min_similarity, size_t max_results) {
+    uint64_t similarity_bits;
+    std::memcpy(&similarity_bits, &min_similarity, sizeof(similarity_bits));
     
-    // Use raw hash as cache key (or first N characters for large fingerprints)
-    if (fingerprint.raw_hash.length() <= 64) {
-        return fingerprint.raw_hash;
-    }
-    return fingerprint.raw_hash.substr(0, 64);
+    uint64_t h = rotl64(similarity_bits * K_MUL1, 31) * K_MUL2;
+    h = rotl64(h ^ (static_cast<uint64_t>(max_results) * K_MUL1), 31) * K_MUL2;
+    return finalize64(h);
 }
 
 MatcherService::ServiceStats MatcherService::getStats() const {
@@ -183,39 +850,36 @@ MatcherService::ServiceStats MatcherService::getStats() const {
     stats.total_requests = total_requests_.load(std::memory_order_relaxed);
     stats.successful_matches = successful_matches_.load(std::memory_order_relaxed);
     stats.cache_hits = cache_hits_.load(std::memory_order_relaxed);
+    stats.cache_near_hits = cache_near_hits_.load(std::memory_order_relaxed);
     stats.cache_misses = cache_misses_.load(std::memory_order_relaxed);
+    stats.coalesced_requests = coalesced_requests_.load(std::memory_order_relaxed);
+    stats.partial_matches = partial_matches_.load(std::memory_order_relaxed);
+    stats.expired_requests = expired_requests_.load(std::memory_order_relaxed);
+    stats.rejected_requests = rejected_requests_.load(std::memory_order_relaxed);
+    stats.queue_depth = queued_.load(std::memory_order_relaxed);
+    stats.cache_bytes = cache_->sizeBytes();
 
-    // Calculate latency statistics
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    
-    if (!latencies_.empty()) {
-        auto sorted_latencies = latencies_;
-        std::sort(sorted_latencies.begin(), sorted_latencies.end());
-        
-        stats.avg_latency_us = std::accumulate(
-            sorted_latencies.begin(), 
-            sorted_latencies.end(), 
-            0.0
-        ) / sorted_latencies.size();
-        
-        size_t p95_idx = static_cast<size_t>(sorted_latencies.size() * 0.95);
-        size_t p99_idx = static_cast<size_t>(sorted_latencies.size() * 0.99);
-        
-        stats.p95_latency_us = sorted_latencies[p95_idx];
-        stats.p99_latency_us = sorted_latencies[p99_idx];
-    } else {
-        stats.avg_latency_us = 0.0;
-        stats.p95_latency_us = 0.0;
-        stats.p99_latency_us = 0.0;
-    }
+    // Merged from the per-thread stripes without stopping recorders
+    auto latencies = latencies_.snapshot();
+    stats.avg_latency_us = latencies.mean();
+    stats.p95_latency_us = latencies.percentile(0.95);
+    stats.p99_latency_us = latencies.percentile(0.99);
 
     return stats;
 }
 
+std::unique_ptr<StreamMonitor> MatcherService::createStreamMonitor(
+    StreamMonitor::EventHandler handler,
+    const StreamMonitor::Config& config) {
+    return std::make_unique<StreamMonitor>(db_manager_, metrics_, std::move(handler), config);
+}
+
+std::vector<ResultCache::ShardStats> MatcherService::getCacheShardStats() const {
+    return cache_->getShardStats();
+}
+
 void MatcherService::clearCache() {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
-    cache_.clear();
-    cache_lru_.clear();
+    cache_->clear();
 }
 
 } // namespace matcher
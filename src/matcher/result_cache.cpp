@@ -0,0 +1,409 @@
+#include "matcher/result_cache.h"
+#include "core/hamming.h"
+#include <algorithm>
+#include <limits>
+#include <string>
+
+namespace vfs {
+namespace matcher {
+
+namespace {
+
+constexpr size_t NUM_MINHASHES = ResultCache::SIGNATURE_BANDS * ResultCache::ROWS_PER_BAND;
+
+/**
+ * @brief splitmix64 finaliser: sub-fingerprints are far from uniform
+ */
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Odd multipliers and offsets of the min-hash permutations
+ */
+struct MinHashFamily {
+    std::array<uint64_t, NUM_MINHASHES> mul;
+    std::array<uint64_t, NUM_MINHASHES> add;
+
+    MinHashFamily() {
+        for (size_t i = 0; i < NUM_MINHASHES; ++i) {
+            mul[i] = mix64(2 * i) | 1;
+            add[i] = mix64(2 * i + 1);
+        }
+    }
+};
+
+const MinHashFamily& minHashFamily() {
+    static const MinHashFamily family;
+    return family;
+}
+
+/**
+ * @brief Heap bytes of a string (zero when held in the small-string buffer)
+ */
+size_t heapBytes(const std::string& str) {
+    const char* begin = reinterpret_cast<const char*>(&str);
+    bool inline_buffer = str.data() >= begin && str.data() < begin + sizeof(str);
+    return inline_buffer ? 0 : str.capacity() + 1;
+}
+
+// Hash node, bucket slot and LRU list node per entry, roughly
+constexpr size_t NODE_OVERHEAD = 64;
+
+} // namespace
+
+const SharedResults::ResultSet& SharedResults::get() const {
+    static const ResultSet empty;
+    return results_ ? *results_ : empty;
+}
+
+ResultCache::ResultCache(const Config& config)
+    : config_(config)
+    , shard_bits_(0) {
+
+    size_t limit = std::max<size_t>(1, std::min(config_.num_shards, config_.capacity));
+    while ((size_t(2) << shard_bits_) <= limit) {
+        ++shard_bits_;
+    }
+
+    size_t count = size_t(1) << shard_bits_;
+    shards_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto shard = std::make_unique<Shard>();
+        // Spread the remainder so the shard capacities add up to capacity
+        shard->capacity = config_.capacity / count + (i < config_.capacity % count ? 1 : 0);
+        shard->byte_capacity = config_.max_bytes / count + (i < config_.max_bytes % count ? 1 : 0);
+        shards_.push_back(std::move(shard));
+    }
+
+    if (nearDuplicatesEnabled()) {
+        bands_.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            bands_.push_back(std::make_unique<BandStripe>());
+        }
+    }
+}
+
+ResultCache::Shard& ResultCache::shardFor(Key key) {
+    if (shard_bits_ == 0) {
+        return *shards_[0];
+    }
+    // Fibonacci hashing picks the shard from the high bits, while
+    // unordered_map inside the shard buckets by the low bits of the key
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    return *shards_[h >> (64 - shard_bits_)];
+}
+
+ResultCache::BandStripe& ResultCache::stripeFor(uint64_t band_key) {
+    if (shard_bits_ == 0) {
+        return *bands_[0];
+    }
+    return *bands_[band_key >> (64 - shard_bits_)];
+}
+
+ResultCache::Signature ResultCache::signature(const std::vector<uint32_t>& hashes, uint64_t salt) {
+    const MinHashFamily& family = minHashFamily();
+
+    std::array<uint64_t, NUM_MINHASHES> mins;
+    mins.fill(std::numeric_limits<uint64_t>::max());
+
+    // Set semantics: shifting the query or repeating frames keeps the minima
+    for (uint32_t hash : hashes) {
+        uint64_t x = mix64(hash);
+        for (size_t i = 0; i < NUM_MINHASHES; ++i) {
+            mins[i] = std::min(mins[i], x * family.mul[i] + family.add[i]);
+        }
+    }
+
+    Signature sig;
+    sig.salt = salt;
+    for (size_t b = 0; b < SIGNATURE_BANDS; ++b) {
+        uint64_t h = mix64(salt ^ (b + 1));
+        for (size_t r = 0; r < ROWS_PER_BAND; ++r) {
+            h = mix64(h ^ mins[b * ROWS_PER_BAND + r]);
+        }
+        sig.bands[b] = h;
+    }
+    return sig;
+}
+
+double ResultCache::querySimilarity(
+    const std::vector<uint32_t>& a,
+    const std::vector<uint32_t>& b) const {
+
+    size_t longest = std::max(a.size(), b.size());
+    if (a.empty() || b.empty()) {
+        return 0.0;
+    }
+
+    // Words outside the overlap count as disagreeing, so a short query
+    // never verifies against a much longer one
+    int64_t max_shift = static_cast<int64_t>(config_.near_duplicate_max_shift);
+    uint64_t best = 0;
+    for (int64_t shift = -max_shift; shift <= max_shift; ++shift) {
+        best = std::max(best, core::alignedMatchingBits(
+            a.data(), a.size(), b.data(), b.size(), shift));
+    }
+    return static_cast<double>(best) / (32.0 * longest);
+}
+
+size_t ResultCache::estimateBytes(const Entry& entry) {
+    size_t bytes = sizeof(Key) + sizeof(Entry) + NODE_OVERHEAD;
+    bytes += sizeof(ResultSet) + entry.results->capacity() * sizeof(database::DatabaseManager::MatchResult);
+    for (const auto& result : *entry.results) {
+        bytes += heapBytes(result.metadata.content_id);
+        bytes += heapBytes(result.metadata.title);
+        bytes += heapBytes(result.metadata.source);
+    }
+    if (entry.query) {
+        bytes += sizeof(*entry.query) + entry.query->capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+bool ResultCache::isStale(const Entry& entry, uint64_t generation,
+                          std::chrono::steady_clock::time_point now) const {
+    if (entry.generation < generation) {
+        return true;
+    }
+    return config_.ttl.count() > 0 && now - entry.timestamp > config_.ttl;
+}
+
+std::optional<ResultCache::Signature> ResultCache::removeEntry(
+    Shard& shard, std::unordered_map<Key, Entry>::iterator it) {
+
+    std::optional<Signature> signature = std::move(it->second.signature);
+    shard.bytes -= it->second.bytes;
+    shard.lru.erase(it->second.lru_position);
+    shard.entries.erase(it);
+    return signature;
+}
+
+ResultCache::Results ResultCache::lookup(Key key, uint64_t generation) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        ++shard.misses;
+        return nullptr;
+    }
+
+    if (!isStale(it->second, generation, std::chrono::steady_clock::now())) {
+        ++shard.hits;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+        return it->second.results;
+    }
+
+    if (auto stale = removeEntry(shard, it)) {
+        unindexBands(key, *stale);
+    }
+    ++shard.expirations;
+    ++shard.misses;
+    return nullptr;
+}
+
+ResultCache::Results ResultCache::lookupSimilar(
+    const Signature& signature,
+    const std::vector<uint32_t>& query,
+    uint64_t generation) {
+
+    if (!nearDuplicatesEnabled()) {
+        return nullptr;
+    }
+
+    // Collect candidate entries, one stripe lock at a time
+    std::array<Key, SIGNATURE_BANDS> candidates;
+    size_t num_candidates = 0;
+    for (uint64_t band_key : signature.bands) {
+        BandStripe& stripe = stripeFor(band_key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+
+        auto it = stripe.keys.find(band_key);
+        if (it != stripe.keys.end() &&
+            std::find(candidates.begin(), candidates.begin() + num_candidates, it->second) ==
+                candidates.begin() + num_candidates) {
+            candidates[num_candidates++] = it->second;
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    for (size_t c = 0; c < num_candidates; ++c) {
+        Shard& shard = shardFor(candidates[c]);
+        std::shared_ptr<const std::vector<uint32_t>> stored;
+        Results results;
+
+        // Only take what verification needs under the lock
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto it = shard.entries.find(candidates[c]);
+            if (it == shard.entries.end() || !it->second.signature ||
+                it->second.signature->salt != signature.salt) {
+                continue;
+            }
+
+            if (isStale(it->second, generation, now)) {
+                if (auto stale = removeEntry(shard, it)) {
+                    unindexBands(candidates[c], *stale);
+                }
+                ++shard.expirations;
+                continue;
+            }
+
+            stored = it->second.query;
+            results = it->second.results;
+        }
+
+        // Verified: shared bands only suggest the queries are close
+        if (!stored || querySimilarity(query, *stored) < config_.near_duplicate_similarity) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.near_hits;
+        auto it = shard.entries.find(candidates[c]);
+        if (it != shard.entries.end() && it->second.query == stored) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+        }
+        return results;
+    }
+
+    return nullptr;
+}
+
+void ResultCache::insert(Key key, Results results,
+                         uint64_t generation,
+                         const Signature* signature,
+                         const std::vector<uint32_t>* query) {
+    if (!results) {
+        return;
+    }
+
+    bool near = nearDuplicatesEnabled() && signature && query;
+
+    Entry entry;
+    entry.results = std::move(results);
+    entry.timestamp = std::chrono::steady_clock::now();
+    entry.generation = generation;
+    if (near) {
+        entry.query = std::make_shared<const std::vector<uint32_t>>(*query);
+        entry.signature = *signature;
+    }
+
+    // Bands are updated under the shard lock, so they never point at an
+    // entry another thread has evicted in the meantime
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Replace an existing entry; it keeps any band keys it had
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        if (!near && it->second.signature) {
+            entry.query = std::move(it->second.query);
+            entry.signature = it->second.signature;
+        }
+        removeEntry(shard, it);
+    }
+
+    entry.bytes = estimateBytes(entry);
+    if (shard.capacity == 0 ||
+        (shard.byte_capacity > 0 && entry.bytes > shard.byte_capacity)) {
+        if (entry.signature) {
+            unindexBands(key, *entry.signature);
+        }
+        return;
+    }
+
+    // Remove least recently used entries until the new one fits
+    while (!shard.entries.empty() &&
+           (shard.entries.size() >= shard.capacity ||
+            (shard.byte_capacity > 0 && shard.bytes + entry.bytes > shard.byte_capacity))) {
+        auto lru = shard.entries.find(shard.lru.back());
+        Key lru_key = lru->first;
+        if (auto lru_signature = removeEntry(shard, lru)) {
+            unindexBands(lru_key, *lru_signature);
+        }
+        ++shard.evictions;
+    }
+
+    shard.lru.push_front(key);
+    entry.lru_position = shard.lru.begin();
+    shard.bytes += entry.bytes;
+
+    if (near) {
+        indexBands(key, *signature);
+    }
+    shard.entries.emplace(key, std::move(entry));
+}
+
+void ResultCache::indexBands(Key key, const Signature& signature) {
+    for (uint64_t band_key : signature.bands) {
+        BandStripe& stripe = stripeFor(band_key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        stripe.keys[band_key] = key;
+    }
+}
+
+void ResultCache::unindexBands(Key key, const Signature& signature) {
+    for (uint64_t band_key : signature.bands) {
+        BandStripe& stripe = stripeFor(band_key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+
+        // A newer entry may have taken the band over since
+        auto it = stripe.keys.find(band_key);
+        if (it != stripe.keys.end() && it->second == key) {
+            stripe.keys.erase(it);
+        }
+    }
+}
+
+void ResultCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->entries.clear();
+        shard->lru.clear();
+        shard->bytes = 0;
+    }
+    for (auto& stripe : bands_) {
+        std::lock_guard<std::mutex> lock(stripe->mutex);
+        stripe->keys.clear();
+    }
+}
+
+size_t ResultCache::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->entries.size();
+    }
+    return total;
+}
+
+size_t ResultCache::sizeBytes() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->bytes;
+    }
+    return total;
+}
+
+std::vector<ResultCache::ShardStats> ResultCache::getShardStats() const {
+    std::vector<ShardStats> stats;
+    stats.reserve(shards_.size());
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.push_back({shard->hits, shard->near_hits, shard->misses, shard->evictions,
+                         shard->expirations, shard->entries.size(), shard->bytes});
+    }
+    return stats;
+}
+
+} // namespace matcher
+} // namespace vfs
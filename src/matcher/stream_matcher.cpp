@@ -0,0 +1,195 @@
+#include "matcher/stream_matcher.h"
+#include <algorithm>
+
+namespace vfs {
+namespace matcher {
+
+void PostingBatch::resolve(database::DatabaseManager& db_manager) {
+    std::sort(hashes_.begin(), hashes_.end());
+    hashes_.erase(std::unique(hashes_.begin(), hashes_.end()), hashes_.end());
+
+    begins_.clear();
+    begins_.reserve(hashes_.size() + 1);
+    postings_.clear();
+
+    std::vector<index::Posting> found;
+    for (uint32_t hash : hashes_) {
+        begins_.push_back(postings_.size());
+        size_t count = db_manager.lookupPostings(hash, found);
+        postings_.insert(postings_.end(), found.begin(), found.begin() + count);
+    }
+    begins_.push_back(postings_.size());
+}
+
+std::pair<const index::Posting*, size_t> PostingBatch::find(uint32_t hash) const {
+    auto it = std::lower_bound(hashes_.begin(), hashes_.end(), hash);
+    if (it == hashes_.end() || *it != hash || begins_.size() != hashes_.size() + 1) {
+        return {nullptr, 0};
+    }
+    size_t i = static_cast<size_t>(it - hashes_.begin());
+    return {postings_.data() + begins_[i], begins_[i + 1] - begins_[i]};
+}
+
+void PostingBatch::clear() {
+    hashes_.clear();
+    begins_.clear();
+    postings_.clear();
+}
+
+StreamMatcher::StreamMatcher(
+    std::shared_ptr<database::DatabaseManager> db_manager,
+    const Config& config)
+    : db_manager_(db_manager)
+    , config_(config) {
+    config_.window_hashes = std::max<size_t>(config_.window_hashes, 1);
+    config_.end_votes = std::min(config_.end_votes, config_.start_votes);
+}
+
+std::vector<StreamMatcher::MatchEvent>
+StreamMatcher::push(const std::vector<uint32_t>& hashes) {
+    std::vector<MatchEvent> events;
+
+    for (uint32_t hash : hashes) {
+        size_t count = db_manager_->lookupPostings(hash, postings_);
+        advance(postings_.data(), count);
+    }
+    evaluate(events);
+
+    return events;
+}
+
+std::vector<StreamMatcher::MatchEvent>
+StreamMatcher::push(const std::vector<uint32_t>& hashes, const PostingBatch& batch) {
+    std::vector<MatchEvent> events;
+
+    for (uint32_t hash : hashes) {
+        auto [postings, count] = batch.find(hash);
+        advance(postings, count);
+    }
+    evaluate(events);
+
+    return events;
+}
+
+std::vector<StreamMatcher::MatchEvent> StreamMatcher::finish() {
+    std::vector<MatchEvent> events;
+
+    for (const auto& [content, active] : active_) {
+        events.push_back({EventType::End, active.content_id, position_,
+                          static_cast<int64_t>(position_) + active.offset,
+                          votesAt(content, active.offset)});
+    }
+    std::sort(events.begin(), events.end(),
+        [](const MatchEvent& a, const MatchEvent& b) {
+            return a.content_id < b.content_id;
+        });
+
+    active_.clear();
+    window_.clear();
+    votes_.clear();
+    touched_.clear();
+    return events;
+}
+
+std::vector<StreamMatcher::ActiveMatch> StreamMatcher::activeMatches() const {
+    std::vector<ActiveMatch> matches;
+    matches.reserve(active_.size());
+
+    for (const auto& [content, active] : active_) {
+        matches.push_back({active.content_id, active.start_position, active.offset,
+                           votesAt(content, active.offset)});
+    }
+    return matches;
+}
+
+void StreamMatcher::advance(const index::Posting* postings, size_t count) {
+    // Offsets are content position minus stream position, constant while
+    // the stream plays the content through
+    std::vector<Hit> hits;
+    hits.reserve(count);
+
+    for (size_t p = 0; p < count; ++p) {
+        Hit hit = {postings[p].content,
+                   static_cast<int64_t>(postings[p].position) - static_cast<int64_t>(position_)};
+        ++votes_[hit.content][hit.offset];
+        touched_.insert(hit.content);
+        hits.push_back(hit);
+    }
+
+    window_.push_back(std::move(hits));
+    ++position_;
+
+    // Take back the votes of the sub-fingerprint leaving the window
+    if (window_.size() > config_.window_hashes) {
+        for (const Hit& hit : window_.front()) {
+            auto content = votes_.find(hit.content);
+            auto offset = content->second.find(hit.offset);
+            if (--offset->second == 0) {
+                content->second.erase(offset);
+                if (content->second.empty()) {
+                    votes_.erase(content);
+                }
+            }
+            touched_.insert(hit.content);
+        }
+        window_.pop_front();
+    }
+}
+
+void StreamMatcher::evaluate(std::vector<MatchEvent>& events) {
+    // Ordered, so events of one push do not depend on hash-set iteration
+    std::vector<uint32_t> touched(touched_.begin(), touched_.end());
+    std::sort(touched.begin(), touched.end());
+    touched_.clear();
+
+    for (uint32_t content : touched) {
+        auto active = active_.find(content);
+        if (active != active_.end()) {
+            uint32_t votes = votesAt(content, active->second.offset);
+            if (votes >= config_.end_votes) {
+                continue;
+            }
+            events.push_back({EventType::End, active->second.content_id, position_,
+                              static_cast<int64_t>(position_) + active->second.offset, votes});
+            active_.erase(active);
+        }
+
+        auto offsets = votes_.find(content);
+        if (offsets == votes_.end()) {
+            continue;
+        }
+
+        // Highest vote wins; ties go to the smallest offset
+        int64_t best_offset = 0;
+        uint32_t best_votes = 0;
+        for (const auto& [offset, votes] : offsets->second) {
+            if (votes > best_votes || (votes == best_votes && offset < best_offset)) {
+                best_offset = offset;
+                best_votes = votes;
+            }
+        }
+        if (best_votes < config_.start_votes) {
+            continue;
+        }
+
+        auto content_id = db_manager_->getContentIdForPosting(content);
+        if (!content_id) {
+            continue;
+        }
+        active_.emplace(content, Active{*content_id, position_, best_offset});
+        events.push_back({EventType::Start, *content_id, position_,
+                          static_cast<int64_t>(position_) + best_offset, best_votes});
+    }
+}
+
+uint32_t StreamMatcher::votesAt(uint32_t content, int64_t offset) const {
+    auto offsets = votes_.find(content);
+    if (offsets == votes_.end()) {
+        return 0;
+    }
+    auto votes = offsets->second.find(offset);
+    return votes == offsets->second.end() ? 0 : votes->second;
+}
+
+} // namespace matcher
+} // namespace vfs
@@ -0,0 +1,287 @@
+#include "matcher/stream_monitor.h"
+#include <algorithm>
+
+namespace vfs {
+namespace matcher {
+
+StreamMonitor::StreamMonitor(
+    std::shared_ptr<database::DatabaseManager> db_manager,
+    std::shared_ptr<monitoring::MetricsCollector> metrics,
+    EventHandler handler,
+    const Config& config)
+    : db_manager_(db_manager)
+    , metrics_(metrics)
+    , handler_(std::move(handler))
+    , config_(config) {
+
+    size_t num_workers = std::max<size_t>(config_.num_workers, 1);
+    load_.assign(num_workers, 0);
+
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (auto& worker : workers_) {
+        Worker* w = worker.get();
+        worker->thread = std::thread([this, w]() { workerLoop(*w); });
+    }
+}
+
+StreamMonitor::~StreamMonitor() {
+    stop_.store(true);
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->wake_cv.notify_all();
+        worker->done_cv.notify_all();
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+bool StreamMonitor::addChannel(const std::string& channel) {
+    std::lock_guard<std::mutex> lock(channels_mutex_);
+    if (assignment_.count(channel)) {
+        return false;
+    }
+
+    size_t w = static_cast<size_t>(
+        std::min_element(load_.begin(), load_.end()) - load_.begin());
+
+    auto state = std::make_shared<Channel>();
+    state->name = channel;
+    state->session = std::make_unique<StreamMatcher>(db_manager_, config_.session);
+
+    {
+        std::lock_guard<std::mutex> worker_lock(workers_[w]->mutex);
+        if (!workers_[w]->channels.emplace(channel, std::move(state)).second) {
+            return false;
+        }
+    }
+    assignment_.emplace(channel, Assignment{w, false});
+    ++load_[w];
+    return true;
+}
+
+bool StreamMonitor::removeChannel(const std::string& channel) {
+    // The name stays reserved until the worker has let go of the channel
+    // and its session is finished, so it cannot be added again meanwhile
+    size_t w;
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex_);
+        auto it = assignment_.find(channel);
+        if (it == assignment_.end() || it->second.removing) {
+            return false;
+        }
+        it->second.removing = true;
+        w = it->second.worker;
+    }
+
+    std::shared_ptr<Channel> state;
+    {
+        // Wait out a tick in progress, so the session is not in use
+        Worker& worker = *workers_[w];
+        std::lock_guard<std::mutex> tick_lock(worker.tick_mutex);
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            auto it = worker.channels.find(channel);
+            if (it != worker.channels.end()) {
+                state = std::move(it->second);
+                worker.channels.erase(it);
+                worker.matched += state->pending.size();
+            }
+        }
+        worker.done_cv.notify_all();
+    }
+
+    if (state) {
+        for (const auto& event : state->session->finish()) {
+            handler_(channel, event);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex_);
+        assignment_.erase(channel);
+        --load_[w];
+    }
+
+    return state != nullptr;
+}
+
+bool StreamMonitor::feed(
+    const std::string& channel,
+    std::vector<uint32_t> hashes,
+    Clock::time_point captured) {
+
+    size_t w;
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex_);
+        auto it = assignment_.find(channel);
+        if (it == assignment_.end() || it->second.removing) {
+            return false;
+        }
+        w = it->second.worker;
+    }
+
+    Worker& worker = *workers_[w];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    // Removed since the assignment was read
+    auto it = worker.channels.find(channel);
+    if (it == worker.channels.end()) {
+        return false;
+    }
+
+    it->second->pending_hashes += hashes.size();
+    it->second->pending.push_back(Input{std::move(hashes), captured});
+    ++worker.fed;
+    return true;
+}
+
+void StreamMonitor::flush() {
+    std::vector<uint64_t> targets;
+    targets.reserve(workers_.size());
+
+    // Wake every worker first, so they drain in parallel
+    for (auto& worker : workers_) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            targets.push_back(worker->fed);
+            worker->flush_requested = true;
+        }
+        worker->wake_cv.notify_one();
+    }
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        Worker& worker = *workers_[i];
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.done_cv.wait(lock, [this, &worker, target = targets[i]]() {
+            return worker.matched >= target || stop_.load();
+        });
+    }
+}
+
+std::vector<StreamMonitor::ChannelStats> StreamMonitor::getChannelStats() const {
+    std::vector<ChannelStats> stats;
+    auto now = Clock::now();
+
+    for (size_t w = 0; w < workers_.size(); ++w) {
+        Worker& worker = *workers_[w];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        for (const auto& [name, channel] : worker.channels) {
+            ChannelStats channel_stats;
+            channel_stats.channel = name;
+            channel_stats.worker = w;
+            channel_stats.position = channel->position;
+            channel_stats.pending_hashes = channel->pending_hashes;
+            channel_stats.lag_us = channel->pending.empty()
+                ? channel->last_lag_us
+                : static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                      now - channel->pending.front().captured).count());
+            stats.push_back(channel_stats);
+        }
+    }
+
+    std::sort(stats.begin(), stats.end(),
+        [](const ChannelStats& a, const ChannelStats& b) {
+            return a.channel < b.channel;
+        });
+    return stats;
+}
+
+size_t StreamMonitor::numChannels() const {
+    std::lock_guard<std::mutex> lock(channels_mutex_);
+    return assignment_.size();
+}
+
+void StreamMonitor::workerLoop(Worker& worker) {
+    auto period = std::chrono::milliseconds(config_.tick_ms);
+
+    while (!stop_.load()) {
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.wake_cv.wait_for(lock, period, [this, &worker]() {
+                return stop_.load() || worker.flush_requested;
+            });
+            worker.flush_requested = false;
+        }
+        if (stop_.load()) {
+            break;
+        }
+        tick(worker);
+    }
+}
+
+void StreamMonitor::tick(Worker& worker) {
+    std::lock_guard<std::mutex> tick_lock(worker.tick_mutex);
+
+    // Take the queued input, leaving feeders free to queue more
+    std::vector<std::pair<std::shared_ptr<Channel>, std::deque<Input>>> work;
+    uint64_t taken = 0;
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        for (auto& [name, channel] : worker.channels) {
+            if (!channel->pending.empty()) {
+                taken += channel->pending.size();
+                work.emplace_back(channel, std::move(channel->pending));
+                channel->pending.clear();
+                channel->pending_hashes = 0;
+            }
+        }
+    }
+
+    if (work.empty()) {
+        return;
+    }
+
+    // One lookup per distinct hash across every channel of this worker
+    worker.batch.clear();
+    size_t total_hashes = 0;
+    for (const auto& [channel, inputs] : work) {
+        for (const auto& input : inputs) {
+            for (uint32_t hash : input.hashes) {
+                worker.batch.add(hash);
+            }
+            total_hashes += input.hashes.size();
+        }
+    }
+    {
+        monitoring::MetricsCollector::Timer timer(metrics_.get(), "stream_tick_lookup");
+        worker.batch.resolve(*db_manager_);
+    }
+    metrics_->incrementCounter("stream_ticks");
+    if (total_hashes > 0) {
+        metrics_->recordGauge("stream_tick_lookup_ratio",
+                              static_cast<double>(worker.batch.lookups()) / total_hashes);
+    }
+
+    for (auto& [channel, inputs] : work) {
+        uint64_t lag_us = 0;
+        for (const auto& input : inputs) {
+            for (const auto& event : channel->session->push(input.hashes, worker.batch)) {
+                handler_(channel->name, event);
+            }
+            lag_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - input.captured).count());
+            metrics_->recordLatency("stream_lag", lag_us);
+        }
+
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        channel->position = channel->session->position();
+        channel->last_lag_us = lag_us;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.matched += taken;
+    }
+    worker.done_cv.notify_all();
+}
+
+} // namespace matcher
+} // namespace vfs
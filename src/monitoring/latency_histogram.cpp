@@ -0,0 +1,139 @@
+#include "monitoring/latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace vfs {
+namespace monitoring {
+
+namespace {
+
+// Threads take stripes round-robin on first use
+std::atomic<size_t> next_stripe{0};
+
+inline unsigned log2Floor(uint64_t value) {
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : stripes_(NUM_STRIPES) {
+    reset();
+}
+
+size_t LatencyHistogram::bucketFor(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+
+    unsigned exponent = log2Floor(value);
+    if (exponent > MAX_EXPONENT) {
+        return NUM_BUCKETS - 1;
+    }
+
+    // Top SUB_BUCKET_BITS bits below the leading one pick the sub-bucket
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    size_t sub_bucket = static_cast<size_t>(value >> shift) - SUB_BUCKETS;
+    return SUB_BUCKETS + shift * SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucketLow(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    size_t shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    size_t sub_bucket = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return static_cast<uint64_t>(SUB_BUCKETS + sub_bucket) << shift;
+}
+
+uint64_t LatencyHistogram::bucketHigh(size_t bucket) {
+    if (bucket + 1 >= NUM_BUCKETS) {
+        return UINT64_MAX;
+    }
+    return bucketLow(bucket + 1) - 1;
+}
+
+LatencyHistogram::Stripe& LatencyHistogram::localStripe() {
+    thread_local size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+    return stripes_[stripe % NUM_STRIPES];
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    Stripe& stripe = localStripe();
+
+    stripe.buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t seen = stripe.min.load(std::memory_order_relaxed);
+    while (value < seen &&
+           !stripe.min.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    seen = stripe.max.load(std::memory_order_relaxed);
+    while (value > seen &&
+           !stripe.max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+
+    // Last, so a reader that sees the count also sees the bucket
+    stripe.count.fetch_add(1, std::memory_order_release);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.buckets.assign(NUM_BUCKETS, 0);
+    uint64_t min = UINT64_MAX;
+
+    for (const Stripe& stripe : stripes_) {
+        if (stripe.count.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            snapshot.buckets[b] += stripe.buckets[b].load(std::memory_order_relaxed);
+        }
+        snapshot.sum += stripe.sum.load(std::memory_order_relaxed);
+        min = std::min(min, stripe.min.load(std::memory_order_relaxed));
+        snapshot.max = std::max(snapshot.max, stripe.max.load(std::memory_order_relaxed));
+    }
+
+    // Counted from the buckets, so percentiles are consistent with them
+    for (uint64_t bucket_count : snapshot.buckets) {
+        snapshot.count += bucket_count;
+    }
+    snapshot.min = snapshot.count ? min : 0;
+    return snapshot;
+}
+
+double LatencyHistogram::Snapshot::percentile(double quantile) const {
+    if (count == 0) {
+        return 0.0;
+    }
+
+    quantile = std::min(std::max(quantile, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(
+        static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(count))), 1);
+
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets.size(); ++b) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            // Middle of the bucket, within what was actually observed
+            uint64_t low = bucketLow(b);
+            uint64_t high = bucketHigh(b);
+            double middle = static_cast<double>(low) + static_cast<double>(high - low) / 2.0;
+            return std::min(std::max(middle, static_cast<double>(min)), static_cast<double>(max));
+        }
+    }
+    return static_cast<double>(max);
+}
+
+void LatencyHistogram::reset() {
+    for (Stripe& stripe : stripes_) {
+        for (auto& bucket : stripe.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        stripe.count.store(0, std::memory_order_relaxed);
+        stripe.sum.store(0, std::memory_order_relaxed);
+        stripe.min.store(UINT64_MAX, std::memory_order_relaxed);
+        stripe.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace monitoring
+} // namespace vfs
@@ -0,0 +1,88 @@
+#include "utils/mapped_file.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+
+namespace vfs {
+namespace utils {
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    return map(::open(path.c_str(), O_RDONLY));
+}
+
+std::shared_ptr<MappedFile> MappedFile::openShared(const std::string& name) {
+    return map(shm_open(name.c_str(), O_RDONLY, 0));
+}
+
+bool MappedFile::createShared(const std::string& name, const void* data, size_t size) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    void* addr = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (addr == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    const size_t prefix = size < 8 ? size : 8;
+    auto* target = static_cast<uint8_t*>(addr);
+    std::memcpy(target + prefix, static_cast<const uint8_t*>(data) + prefix, size - prefix);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(target, data, prefix);
+
+    munmap(addr, size);
+    return true;
+}
+
+bool MappedFile::unlinkShared(const std::string& name) {
+    return shm_unlink(name.c_str()) == 0;
+}
+
+std::shared_ptr<MappedFile> MappedFile::map(int fd) {
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<MappedFile>(new MappedFile(static_cast<const uint8_t*>(addr), size));
+}
+
+void MappedFile::adviseWillNeed() const {
+    madvise(const_cast<uint8_t*>(data_), size_, MADV_WILLNEED);
+}
+
+void MappedFile::adviseDontNeed() const {
+    madvise(const_cast<uint8_t*>(data_), size_, MADV_DONTNEED);
+}
+
+} // namespace utils
+} // namespace vfs
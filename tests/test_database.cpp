@@ -1,8 +1,12 @@
 #include "database/database_manager.h"
+#include "database/sql_functions.h"
+#include "database/index_vtab.h"
 #include "core/fingerprint_generator.h"
 #include <iostream>
 #include <cassert>
 #include <filesystem>
+#include <random>
+#include <unistd.h>
 
 using namespace vfs;
 
@@ -88,6 +92,424 @@ void testFindingMatches() {
     std::cout << "PASSED" << std::endl;
 }
 
+void testIndexedMatching() {
+    std::cout << "Test: Indexed Matching... ";
+    
+    std::string test_db = "test_indexed.db";
+    std::filesystem::remove(test_db);
+    
+    database::DatabaseManager db(test_db);
+    db.initialize();
+    
+    core::FingerprintGenerator generator;
+    auto fp = generator.generateFromFile("test.wav");
+    
+    auto store = [&](int i) {
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = "content_" + std::to_string(i);
+        metadata.title = "Test " + std::to_string(i);
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db.storeFingerprint(metadata.content_id, fp, metadata));
+    };
+    
+    // Stored before the index is attached: picked up by the backfill
+    store(0);
+    store(1);
+    auto sql_matches = db.findMatches(fp, 0.0, 10);
+    
+    index::SegmentedIndex::Config config;
+    config.memtable_max_postings = 64;
+    auto posting_index = std::make_shared<index::SegmentedIndex>(config);
+    assert(db.attachIndex(posting_index));
+    
+    auto indexed_matches = db.findMatches(fp, 0.0, 10);
+    assert(indexed_matches.size() == sql_matches.size());
+    for (size_t i = 0; i < sql_matches.size(); ++i) {
+        assert(indexed_matches[i].similarity_score == sql_matches[i].similarity_score);
+    }
+    
+    // Stored after: fed to the index by storeFingerprint
+    store(2);
+    posting_index->waitForBackgroundWork();
+    assert(db.findMatches(fp, 0.0, 10).size() == 3);
+    assert(posting_index->getStats().total_postings == 3 * fp.hash_values.size());
+    
+    // Offline rebuild yields the same postings as a single segment file
+    std::string segment_path = "test_indexed.seg";
+    assert(db.buildIndexSegment(segment_path));
+    auto rebuilt = index::Segment::open(segment_path);
+    assert(rebuilt);
+    assert(rebuilt->numPostings() == 3 * fp.hash_values.size());
+    assert(rebuilt->lookup(fp.hash_values[0]).size() >= 3);
+    
+    // A second process-style reader serves the same postings from one
+    // shared-memory copy instead of backfilling its own
+    std::string shm_name = "/vfs-test-db-" + std::to_string(getpid());
+    index::Segment::unlinkShared(shm_name);
+    assert(rebuilt->publishShared(shm_name));
+    {
+        database::DatabaseManager reader(test_db);
+        assert(reader.initialize());
+        auto shared_index = std::make_shared<index::SegmentedIndex>();
+        shared_index->addSegment(index::Segment::openShared(shm_name));
+        assert(reader.attachIndex(shared_index, false));
+        assert(shared_index->getStats().total_postings == 3 * fp.hash_values.size());
+        assert(reader.findMatches(fp, 0.0, 10).size() == 3);
+    }
+    assert(index::Segment::unlinkShared(shm_name));
+    
+    std::filesystem::remove(segment_path);
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testBitwiseReranking() {
+    std::cout << "Test: Bitwise Re-ranking... ";
+    
+    std::string test_db = "test_rerank.db";
+    std::filesystem::remove(test_db);
+    
+    database::DatabaseManager db(test_db);
+    db.initialize();
+    
+    core::FingerprintGenerator generator;
+    auto original = generator.generateFromFile("test.wav");
+    
+    // Same opening, then 8 flipped bits in every later sub-fingerprint
+    auto edited = original;
+    for (size_t i = edited.hash_values.size() / 2; i < edited.hash_values.size(); ++i) {
+        edited.hash_values[i] ^= 0xFF000000u;
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    
+    metadata.content_id = "original";
+    metadata.title = "Original";
+    assert(db.storeFingerprint(metadata.content_id, original, metadata));
+    
+    metadata.content_id = "edited";
+    metadata.title = "Edited";
+    assert(db.storeFingerprint(metadata.content_id, edited, metadata));
+    
+    // Query with a clip cut from the middle of the original
+    core::FingerprintGenerator::Fingerprint clip;
+    clip.hash_values.assign(original.hash_values.begin() + 5, original.hash_values.end() - 5);
+    
+    auto matches = db.findMatches(clip, 0.0, 10);
+    assert(!matches.empty());
+    assert(matches[0].metadata.content_id == "original");
+    assert(matches[0].similarity_score > 0.999);
+    for (size_t i = 1; i < matches.size(); ++i) {
+        assert(matches[i].similarity_score < matches[0].similarity_score);
+    }
+    
+    // Rows stored as hex text by older versions still score the same
+    sqlite3* raw_db;
+    assert(sqlite3_open(test_db.c_str(), &raw_db) == SQLITE_OK);
+    std::string update = "UPDATE fingerprint_metadata SET raw_hash = '" + original.raw_hash +
+                         "' WHERE content_id = 'original'";
+    assert(sqlite3_exec(raw_db, update.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK);
+    sqlite3_close(raw_db);
+    
+    auto legacy_matches = db.findMatches(clip, 0.0, 10);
+    assert(legacy_matches[0].metadata.content_id == "original");
+    assert(legacy_matches[0].similarity_score > 0.999);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testTieredStorage() {
+    std::cout << "Test: Tiered Storage... ";
+    
+    std::string test_db = "test_tiered_db.db";
+    std::string segment_path = "test_tiered_db.seg";
+    std::string fingerprint_path = "test_tiered_db.fp";
+    std::filesystem::remove(test_db);
+    
+    database::DatabaseManager db(test_db);
+    db.initialize();
+    
+    core::FingerprintGenerator generator;
+    auto original = generator.generateFromFile("test.wav");
+    auto edited = original;
+    for (size_t i = edited.hash_values.size() / 2; i < edited.hash_values.size(); ++i) {
+        edited.hash_values[i] ^= 0xFF000000u;
+    }
+    
+    auto store = [&](const std::string& content_id, const core::FingerprintGenerator::Fingerprint& fp) {
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = content_id;
+        metadata.title = content_id;
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db.storeFingerprint(metadata.content_id, fp, metadata));
+    };
+    
+    store("original", original);
+    store("edited", edited);
+    auto sql_matches = db.findMatches(original, 0.0, 10);
+    
+    // Postings and fingerprints are served from the store's files
+    assert(db.buildIndexSegment(segment_path));
+    assert(db.buildFingerprintFile(fingerprint_path));
+    
+    index::TieredStore::Config config;
+    config.rebalance_interval = 0;
+    auto tiered = std::make_shared<index::TieredStore>(config);
+    assert(tiered->addSegmentFile(segment_path));
+    assert(tiered->openFingerprintFile(fingerprint_path));
+    assert(db.attachTieredStore(tiered));
+    assert(db.hasIndex());
+    
+    auto tiered_matches = db.findMatches(original, 0.0, 10);
+    assert(tiered_matches.size() == sql_matches.size());
+    for (size_t i = 0; i < sql_matches.size(); ++i) {
+        assert(tiered_matches[i].metadata.content_id == sql_matches[i].metadata.content_id);
+        assert(tiered_matches[i].similarity_score == sql_matches[i].similarity_score);
+    }
+    auto stats = tiered->getStats();
+    assert(stats.cold_hits > 0);
+    assert(stats.hot_hits == 0);
+    
+    // Once rebalanced, the same lookups are answered from RAM
+    tiered->rebalance();
+    tiered_matches = db.findMatches(original, 0.0, 10);
+    assert(tiered_matches.size() == sql_matches.size());
+    assert(tiered_matches[0].similarity_score == sql_matches[0].similarity_score);
+    assert(tiered->getStats().hot_hits > 0);
+    
+    // Content stored later is served by an index attached alongside
+    assert(db.attachIndex(std::make_shared<index::SegmentedIndex>(), false));
+    store("late", original);
+    auto late_matches = db.findMatches(original, 0.0, 10);
+    assert(late_matches.size() == sql_matches.size() + 1);
+    assert(late_matches[0].similarity_score > 0.999);
+    assert(late_matches[1].similarity_score > 0.999);
+    
+    std::filesystem::remove(segment_path);
+    std::filesystem::remove(fingerprint_path);
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testQueryDeadline() {
+    std::cout << "Test: Query Deadline... ";
+    
+    std::string test_db = "test_deadline.db";
+    std::filesystem::remove(test_db);
+    
+    database::DatabaseManager db(test_db);
+    db.initialize();
+    
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 1000;
+    for (uint32_t i = 0; i < 500; ++i) {
+        fp.hash_values.push_back(0x2545F491u * (i + 1));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "deadline_content";
+    metadata.title = "Deadline Content";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    assert(db.storeFingerprint(metadata.content_id, fp, metadata));
+    
+    bool partial = true;
+    auto matches = db.findMatches(fp, 0.5, 10, database::DatabaseManager::Deadline::max(), &partial);
+    assert(!partial);
+    assert(matches.size() == 1);
+    
+    // Out of time before the first lookup: nothing found, flagged partial
+    auto expired = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    matches = db.findMatches(fp, 0.5, 10, expired, &partial);
+    assert(partial);
+    assert(matches.empty());
+    
+    // The index path honours the deadline too
+    auto index = std::make_shared<index::SegmentedIndex>();
+    assert(db.attachIndex(index));
+    matches = db.findMatches(fp, 0.5, 10, expired, &partial);
+    assert(partial);
+    assert(matches.empty());
+    
+    auto later = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    matches = db.findMatches(fp, 0.5, 10, later, &partial);
+    assert(!partial);
+    assert(matches.size() == 1);
+    
+    // Out of time after voting: the most-voted candidate is still scored,
+    // the rest come back ranked by their votes
+    core::FingerprintGenerator::Fingerprint prefix = fp;
+    prefix.hash_values.resize(300);
+    metadata.content_id = "deadline_prefix";
+    assert(db.storeFingerprint(metadata.content_id, prefix, metadata));
+    
+    database::DatabaseManager::VoteTable votes;
+    assert(db.voteRange(fp.hash_values, 0, fp.hash_values.size(), votes));
+    matches = db.rankVotes(fp, votes, 0.5, 10, expired, &partial);
+    assert(partial);
+    assert(matches.size() == 2);
+    assert(matches[0].metadata.content_id == "deadline_content");
+    assert(matches[0].scored && matches[0].similarity_score == 1.0);
+    assert(matches[1].metadata.content_id == "deadline_prefix");
+    assert(!matches[1].scored && matches[1].similarity_score == 0.6);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testHashFilter() {
+    std::cout << "Test: Stored-Hash Filter... ";
+    
+    std::string test_db = "test_filter.db";
+    std::filesystem::remove(test_db);
+    
+    std::mt19937 rng(5);
+    core::FingerprintGenerator::Fingerprint stored;
+    stored.duration_ms = 5000;
+    for (int i = 0; i < 200; ++i) {
+        stored.hash_values.push_back(static_cast<uint32_t>(rng()));
+    }
+    
+    // Noisy capture: every other sub-fingerprint is unknown
+    auto capture = stored;
+    for (size_t i = 0; i < capture.hash_values.size(); i += 2) {
+        capture.hash_values[i] = static_cast<uint32_t>(rng());
+    }
+    
+    auto noise = stored;
+    for (auto& hash : noise.hash_values) {
+        hash = static_cast<uint32_t>(rng());
+    }
+    
+    {
+        database::DatabaseManager db(test_db);
+        assert(db.initialize());
+        
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = "stored";
+        metadata.title = "Stored";
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db.storeFingerprint(metadata.content_id, stored, metadata));
+        
+        assert(db.findMatches(capture, 0.0, 10).size() == 1);
+        assert(db.findMatches(noise, 0.0, 10).empty());
+    }
+    
+    // Rebuilt from existing rows, and equivalent to not filtering
+    database::DatabaseManager filtered(test_db);
+    assert(filtered.initialize());
+    
+    database::DatabaseManager::Config config;
+    config.hash_filter_fpr = 0.0;
+    database::DatabaseManager unfiltered(test_db, config);
+    assert(unfiltered.initialize());
+    
+    auto with_filter = filtered.findMatches(capture, 0.0, 10);
+    auto without_filter = unfiltered.findMatches(capture, 0.0, 10);
+    assert(with_filter.size() == 1 && without_filter.size() == 1);
+    assert(with_filter[0].matched_segments == without_filter[0].matched_segments);
+    assert(with_filter[0].similarity_score == without_filter[0].similarity_score);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testSqlFunctions() {
+    std::cout << "Test: SQL Scoring Functions... ";
+    
+    sqlite3* raw_db;
+    assert(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+    assert(database::registerSqlFunctions(raw_db));
+    
+    auto scalar = [raw_db](const char* sql) {
+        sqlite3_stmt* stmt;
+        assert(sqlite3_prepare_v2(raw_db, sql, -1, &stmt, nullptr) == SQLITE_OK);
+        assert(sqlite3_step(stmt) == SQLITE_ROW);
+        double value = sqlite3_column_type(stmt, 0) == SQLITE_NULL
+                     ? -1.0 : sqlite3_column_double(stmt, 0);
+        sqlite3_finalize(stmt);
+        return value;
+    };
+    
+    assert(scalar("SELECT hamming(x'00000000FFFFFFFF', x'0000000000000000')") == 32);
+    assert(scalar("SELECT hamming(x'0F000000', x'00000000')") == 4);
+    assert(scalar("SELECT hamming('text', x'00000000')") == -1.0);
+    
+    // Mismatched or partial-word BLOBs have no defined distance
+    assert(scalar("SELECT hamming(x'00000000FFFFFFFF', x'00000000')") == -1.0);
+    assert(scalar("SELECT hamming(x'000000', x'000000')") == -1.0);
+    assert(scalar("SELECT similarity(x'0000000000', x'00000000', 0)") == -1.0);
+    
+    // a[i] against b[i + 1]: only the first word of a overlaps
+    assert(scalar("SELECT hamming(x'01000000FFFFFFFF', x'0000000001000000', 1)") == 0);
+    assert(scalar("SELECT similarity(x'01000000FFFFFFFF', x'0000000001000000', 1)") == 0.5);
+    
+    assert(scalar("SELECT offset_vote(column1) FROM (VALUES (3), (5), (3), (-2), (3))") == 3);
+    assert(scalar("SELECT best_offset(column1) FROM (VALUES (3), (5), (3), (-2), (3))") == 3);
+    assert(scalar("SELECT best_offset(column1) FROM (VALUES (7), (-1))") == -1);
+    
+    sqlite3_close(raw_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testIndexVirtualTable() {
+    std::cout << "Test: Index Virtual Table... ";
+    
+    index::SegmentedIndex::Config config;
+    config.background_merges = false;
+    auto posting_index = std::make_shared<index::SegmentedIndex>(config);
+    
+    // Half flushed to a segment, half still in the memtable
+    posting_index->addFingerprint(1, {5, 7, 9});
+    posting_index->flush();
+    posting_index->addFingerprint(2, {7, 0xFFFFFFFEu});
+    
+    sqlite3* raw_db;
+    assert(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+    assert(database::registerIndexModule(raw_db, posting_index));
+    assert(sqlite3_exec(raw_db,
+        "CREATE VIRTUAL TABLE temp.postings USING vfs_index;"
+        "CREATE TABLE content (id INTEGER PRIMARY KEY, title TEXT);"
+        "INSERT INTO content VALUES (1, 'one'), (2, 'two');",
+        nullptr, nullptr, nullptr) == SQLITE_OK);
+    
+    auto scalar = [raw_db](const char* sql) {
+        sqlite3_stmt* stmt;
+        assert(sqlite3_prepare_v2(raw_db, sql, -1, &stmt, nullptr) == SQLITE_OK);
+        assert(sqlite3_step(stmt) == SQLITE_ROW);
+        int64_t value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+        return value;
+    };
+    
+    assert(scalar("SELECT COUNT(*) FROM postings") == 5);
+    assert(scalar("SELECT COUNT(*) FROM postings WHERE hash_value = 7") == 2);
+    assert(scalar("SELECT COUNT(*) FROM postings WHERE hash_value = 8") == 0);
+    assert(scalar("SELECT COUNT(*) FROM postings WHERE hash_value IN (5, 9, -2, 100)") == 3);
+    assert(scalar("SELECT position FROM postings WHERE hash_value = -2") == 1);
+    assert(scalar("SELECT SUM(position) FROM postings WHERE content = 1") == 3);
+    
+    // Joins against regular tables resolve through the hash lookup
+    assert(scalar("SELECT COUNT(*) FROM postings p JOIN content c ON c.id = p.content "
+                  "WHERE p.hash_value = 7 AND c.title = 'two'") == 1);
+    
+    sqlite3_close(raw_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
 void testDatabaseStats() {
     std::cout << "Test: Database Statistics... ";
     
@@ -130,6 +552,13 @@ int main() {
         testDatabaseInitialization();
         testStoringFingerprint();
         testFindingMatches();
+        testIndexedMatching();
+        testBitwiseReranking();
+        testTieredStorage();
+        testQueryDeadline();
+        testHashFilter();
+        testSqlFunctions();
+        testIndexVirtualTable();
         testDatabaseStats();
         
         std::cout << std::endl;
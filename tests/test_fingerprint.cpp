@@ -1,5 +1,7 @@
 #include "core/fingerprint_generator.h"
+#include "core/hamming.h"
 #include <iostream>
+#include <cstring>
 #include <cassert>
 #include <cmath>
 
@@ -83,6 +85,31 @@ void testConsistency() {
     std::cout << "PASSED" << std::endl;
 }
 
+void testHammingKernels() {
+    std::cout << "Test: Hamming Kernels... ";
+    
+    uint32_t a[5] = {0x0, 0xFFFFFFFF, 0x0F0F0F0F, 0x1, 0x3};
+    uint32_t b[5] = {0x0, 0x0, 0x0F0F0F0F, 0x0, 0x0};
+    assert(hammingDistance(a, b, 5) == 32 + 1 + 2);
+    
+    // Unaligned input, as handed out by sqlite3_column_blob
+    unsigned char buffer[sizeof(a) + 1];
+    std::memcpy(buffer + 1, a, sizeof(a));
+    assert(hammingDistance(buffer + 1, b, 5) == 35);
+    
+    // query[i] lines up with stored[i + 2]
+    uint32_t stored[6] = {7, 7, 0xAAAA, 0xBBBB, 0xCCCC, 0xDDDD};
+    uint32_t query[3] = {0xAAAA, 0xBBBB, 0xCCCC};
+    assert(alignedMatchingBits(query, 3, stored, 6, 2) == 96);
+    
+    // Words hanging off the end of the stored fingerprint never match
+    assert(alignedMatchingBits(query, 3, stored, 6, 5) == 32 - __builtin_popcount(0xAAAA ^ 0xDDDD));
+    assert(alignedMatchingBits(query, 3, stored, 6, 6) == 0);
+    assert(alignedMatchingBits(query, 3, stored, 6, -3) == 0);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
 int main() {
     std::cout << "=== Fingerprint Generator Tests ===" << std::endl;
     std::cout << std::endl;
@@ -92,6 +119,7 @@ int main() {
         testSimilarityCalculation();
         testEmptyAudio();
         testConsistency();
+        testHammingKernels();
         
         std::cout << std::endl;
         std::cout << "All tests passed!" << std::endl;
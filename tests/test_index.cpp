@@ -0,0 +1,608 @@
+#include "index/segment.h"
+#include "index/segmented_index.h"
+#include "index/tiered_store.h"
+#include "index/index_builder.h"
+#include "index/elias_fano.h"
+#include "index/bloom_filter.h"
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <cassert>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace vfs::index;
+
+void testSegmentBuildAndLookup() {
+    std::cout << "Test: Segment Build and Lookup... ";
+
+    std::vector<PostingEntry> entries = {
+        {10, 1, 0}, {10, 2, 5}, {20, 1, 1}, {30, 3, 7}, {30, 3, 8}
+    };
+
+    auto segment = Segment::build(entries);
+    assert(segment);
+    assert(segment->numPostings() == 5);
+    assert(segment->numKeys() == 3);
+
+    auto range = segment->lookup(10);
+    assert(range.size() == 2);
+    assert(range.begin()[0].content == 1);
+    assert(range.begin()[1].position == 5);
+
+    assert(segment->lookup(30).size() == 2);
+    assert(segment->lookup(15).empty());
+    assert(segment->lookup(99).empty());
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testSegmentMerge() {
+    std::cout << "Test: Segment Merge... ";
+
+    auto a = Segment::build({{1, 1, 0}, {5, 1, 1}});
+    auto b = Segment::build({{5, 2, 0}, {9, 2, 1}});
+
+    auto merged = Segment::merge({a, b});
+    assert(merged->numPostings() == 4);
+    assert(merged->numKeys() == 3);
+    assert(merged->lookup(5).size() == 2);
+    assert(merged->lookup(9).begin()->content == 2);
+
+    // Corrupt buffers are rejected
+    assert(!Segment::fromBuffer(nullptr, merged->data(), 8));
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testMemtableFlushAndMerge() {
+    std::cout << "Test: Memtable Flush and Merge... ";
+
+    SegmentedIndex::Config config;
+    config.memtable_max_postings = 100;
+    config.tier_base_postings = 100;
+    config.merge_fanout = 4;
+    config.background_merges = false;
+
+    SegmentedIndex index(config);
+
+    for (uint32_t content = 0; content < 20; ++content) {
+        std::vector<uint32_t> hashes(50);
+        for (uint32_t i = 0; i < hashes.size(); ++i) {
+            hashes[i] = i % 25;
+        }
+        index.addFingerprint(content, hashes);
+    }
+    index.flush();
+    index.waitForBackgroundWork();
+
+    auto stats = index.getStats();
+    assert(stats.total_postings == 1000);
+    assert(stats.memtable_postings == 0);
+    assert(stats.flushes == 10);
+    assert(stats.merges > 0);
+    assert(stats.num_segments < stats.flushes);
+
+    // Every content contributes two postings for each hash
+    std::vector<Posting> postings;
+    index.lookup(7, postings);
+    assert(postings.size() == 40);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testConcurrentIngestAndLookup() {
+    std::cout << "Test: Concurrent Ingest and Lookup... ";
+
+    SegmentedIndex::Config config;
+    config.memtable_max_postings = 256;
+    config.tier_base_postings = 256;
+
+    SegmentedIndex index(config);
+
+    std::thread writer([&index]() {
+        for (uint32_t i = 0; i < 10000; ++i) {
+            index.add(i % 100, i / 100, i);
+        }
+    });
+
+    // Readers must never see a posting twice while flushes race with them
+    std::thread reader([&index]() {
+        std::vector<Posting> postings;
+        for (int i = 0; i < 2000; ++i) {
+            postings.clear();
+            index.lookup(42, postings);
+            assert(postings.size() <= 100);
+        }
+    });
+
+    writer.join();
+    reader.join();
+
+    index.flush();
+    index.waitForBackgroundWork();
+
+    std::vector<Posting> postings;
+    index.lookup(42, postings);
+    assert(postings.size() == 100);
+    assert(index.getStats().total_postings == 10000);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testTieredStore() {
+    std::cout << "Test: Hot/Cold Tiered Store... ";
+
+    std::string hot_path = "test_tier_hot.seg";
+    std::string cold_path = "test_tier_cold.seg";
+    std::string fp_path = "test_tier.fp";
+
+    assert(Segment::build({{1, 1, 0}, {2, 1, 1}})->writeTo(hot_path));
+    assert(Segment::build({{3, 2, 0}, {4, 2, 1}})->writeTo(cold_path));
+    assert(TieredStore::writeFingerprintFile(fp_path, {{1, {1, 2}}, {2, {3, 4}}}));
+
+    TieredStore::Config config;
+    config.hot_budget_bytes = 150;  // Room for one tiny segment plus a fingerprint
+    config.rebalance_interval = 0;
+
+    TieredStore store(config);
+    assert(store.addSegmentFile(hot_path));
+    assert(store.addSegmentFile(cold_path));
+    assert(store.openFingerprintFile(fp_path));
+    assert(!store.addSegmentFile("missing.seg"));
+
+    std::vector<Posting> postings;
+    for (int i = 0; i < 10; ++i) {
+        store.lookup(1, postings);
+    }
+    store.lookup(3, postings);
+    assert(postings.size() == 11);
+
+    auto fp = store.getFingerprint(2);
+    assert(fp.size == 2 && fp.data[0] == 3);
+    assert(store.getFingerprint(7).empty());
+
+    auto before = store.getStats();
+    assert(before.hot_segments == 0);
+    assert(before.cold_hits == 12);
+
+    store.rebalance();
+
+    auto after = store.getStats();
+    assert(after.promotions > 0);
+    assert(after.hot_segments == 1);
+    assert(after.hot_fingerprints == 1);
+    assert(after.hot_bytes > 0 && after.hot_bytes <= config.hot_budget_bytes);
+
+    // Served from RAM now, same answers
+    postings.clear();
+    store.lookup(1, postings);
+    assert(postings.size() == 1 && postings[0].content == 1);
+    assert(store.getStats().hot_hits > 0);
+
+    // With an interval, lookups only signal; the rebalance runs in the background
+    {
+        TieredStore::Config background_config = config;
+        background_config.rebalance_interval = 5;
+
+        TieredStore background(background_config);
+        assert(background.addSegmentFile(hot_path));
+
+        std::vector<Posting> found;
+        for (int i = 0; i < 5; ++i) {
+            background.lookup(1, found);
+        }
+
+        for (int i = 0; i < 200 && background.getStats().hot_segments == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        assert(background.getStats().hot_segments == 1);
+    }
+
+    // A slot reaching past the data section is rejected, not mapped:
+    // the second slot's count sits after the 40-byte header and one slot
+    {
+        std::fstream file(fp_path, std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t count = 1000;
+        file.seekp(40 + 16 + 4);
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    }
+    assert(!store.openFingerprintFile(fp_path));
+    assert(store.getFingerprint(2).size == 2);
+
+    std::filesystem::remove(hot_path);
+    std::filesystem::remove(cold_path);
+    std::filesystem::remove(fp_path);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testParallelRadixSortBuild() {
+    std::cout << "Test: Parallel Radix Sort Build... ";
+
+    std::mt19937 rng(42);
+    std::vector<PostingEntry> entries;
+    for (uint32_t i = 0; i < 50000; ++i) {
+        // Narrow hash range so many postings share a key
+        entries.push_back({static_cast<uint32_t>(rng() % 4096) * 0x10001u, i % 97, i});
+    }
+
+    auto expected = entries;
+    std::stable_sort(expected.begin(), expected.end(),
+        [](const PostingEntry& a, const PostingEntry& b) { return a.hash < b.hash; });
+
+    for (size_t threads : {1, 3, 8}) {
+        auto sorted = entries;
+        IndexBuilder::radixSort(sorted, threads);
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            assert(sorted[i].hash == expected[i].hash);
+            assert(sorted[i].position == expected[i].position);
+        }
+    }
+
+    IndexBuilder::Config config;
+    config.num_threads = 4;
+    config.min_parallel_entries = 1;
+    IndexBuilder builder(config);
+    for (const auto& entry : entries) {
+        builder.add(entry.hash, entry.content, entry.position);
+    }
+    builder.addFingerprint(1000, {7, 7});
+
+    std::string path = "test_builder.seg";
+    assert(builder.buildFile(path));
+    assert(builder.size() == 0);
+
+    auto segment = Segment::open(path);
+    assert(segment);
+    assert(segment->numPostings() == entries.size() + 2);
+    for (size_t i = 1; i < segment->numKeys(); ++i) {
+        assert(segment->keyAt(i - 1) < segment->keyAt(i));
+    }
+
+    auto range = segment->lookup(7);
+    assert(range.size() == 2);
+    assert(range.begin()[0].position == 0 && range.begin()[1].position == 1);
+
+    std::filesystem::remove(path);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testExternalMergeBuild() {
+    std::cout << "Test: External Merge Build... ";
+
+    std::mt19937 rng(7);
+    std::vector<PostingEntry> entries;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        entries.push_back({static_cast<uint32_t>(rng() % 3000), i % 13, i});
+    }
+
+    // Budget of ~2000 entries per batch forces ten spilled runs
+    IndexBuilder::Config config;
+    config.memory_budget_bytes = 2000 * 2 * sizeof(PostingEntry);
+    config.io_buffer_bytes = 4096;
+    config.spill_directory = ".";
+    IndexBuilder builder(config);
+    for (const auto& entry : entries) {
+        builder.add(entry.hash, entry.content, entry.position);
+    }
+    assert(builder.numRuns() >= 9);
+    assert(builder.size() == entries.size());
+
+    std::string path = "test_external.seg";
+    assert(builder.buildFile(path));
+    assert(builder.numRuns() == 0 && builder.size() == 0);
+
+    IndexBuilder in_memory;
+    for (const auto& entry : entries) {
+        in_memory.add(entry.hash, entry.content, entry.position);
+    }
+    auto expected = in_memory.build();
+
+    // Byte-identical to the in-memory build, ties included
+    auto merged = Segment::open(path);
+    assert(merged);
+    assert(merged->sizeBytes() == expected->sizeBytes());
+    assert(std::equal(merged->data(), merged->data() + merged->sizeBytes(), expected->data()));
+
+    // build() with spilled runs hands back a mapped segment
+    for (const auto& entry : entries) {
+        builder.add(entry.hash, entry.content, entry.position);
+    }
+    auto mapped = builder.build();
+    assert(mapped && mapped->numPostings() == entries.size());
+    assert(mapped->lookup(entries[0].hash).size() == expected->lookup(entries[0].hash).size());
+
+    std::filesystem::remove(path);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testEliasFano() {
+    std::cout << "Test: Elias-Fano Sequence... ";
+
+    std::mt19937 rng(3);
+    for (uint64_t spread : {1ull, 37ull, 1ull << 20, 1ull << 33}) {
+        std::vector<uint64_t> values;
+        uint64_t value = 0;
+        for (int i = 0; i < 3000; ++i) {
+            value += rng() % spread;   // Includes runs of equal values
+            values.push_back(value);
+        }
+
+        auto words = EliasFano::encode(values);
+        EliasFano ef;
+        assert(ef.attach(words.data(), words.size()));
+        assert(ef.size() == values.size());
+
+        for (size_t i = 0; i < values.size(); ++i) {
+            assert(ef.access(i) == values[i]);
+        }
+
+        uint64_t first;
+        uint64_t second;
+        ef.accessPair(1000, first, second);
+        assert(first == values[1000] && second == values[1001]);
+
+        for (int probe = 0; probe < 2000; ++probe) {
+            uint64_t target = values.back() == 0 ? 0 : rng() % (values.back() + 2);
+            uint64_t found = 0;
+            size_t slot = ef.lowerBound(target, found);
+            size_t expected = std::lower_bound(values.begin(), values.end(), target) - values.begin();
+            assert(slot == expected);
+            if (slot < values.size()) {
+                assert(found == values[slot]);
+            }
+        }
+    }
+
+    // Truncated encodings are rejected
+    auto words = EliasFano::encode({1, 5, 9});
+    EliasFano ef;
+    assert(!ef.attach(words.data(), words.size() - 1));
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testCompactDirectory() {
+    std::cout << "Test: Compact Segment Directory... ";
+
+    std::mt19937 rng(11);
+    std::vector<PostingEntry> entries;
+    for (uint32_t i = 0; i < 40000; ++i) {
+        entries.push_back({static_cast<uint32_t>(rng()), i % 31, i});
+    }
+    IndexBuilder::radixSort(entries, 1);
+
+    auto sorted = Segment::build(entries);
+    auto compact = Segment::build(entries, Segment::Directory::EliasFano, 0.01);
+    assert(compact->directory() == Segment::Directory::EliasFano);
+    assert(compact->numKeys() == sorted->numKeys());
+
+    // 12 bytes per key against roughly 2-3
+    assert(compact->directoryBytes() * 3 < sorted->directoryBytes());
+
+    for (size_t i = 0; i < entries.size(); i += 97) {
+        auto expected = sorted->lookup(entries[i].hash);
+        auto range = compact->lookup(entries[i].hash);
+        assert(range.size() == expected.size() && range.begin()->position == expected.begin()->position);
+        assert(compact->lookup(entries[i].hash + 1).size() == sorted->lookup(entries[i].hash + 1).size());
+    }
+    assert(compact->keyAt(5) == sorted->keyAt(5));
+    assert(compact->postingsAt(5).size() == sorted->postingsAt(5).size());
+
+    // Merges may switch encodings, and files keep theirs
+    auto merged = Segment::merge({compact, sorted}, Segment::Directory::EliasFano);
+    assert(merged->numPostings() == 2 * entries.size());
+    assert(merged->lookup(entries[0].hash).size() == 2 * sorted->lookup(entries[0].hash).size());
+
+    std::string path = "test_compact.seg";
+    assert(merged->writeTo(path));
+    auto reopened = Segment::open(path);
+    assert(reopened && reopened->directory() == Segment::Directory::EliasFano);
+    assert(reopened->lookup(entries[100].hash).size() == merged->lookup(entries[100].hash).size());
+
+    // External merge writes the same bytes as an in-memory compact build
+    IndexBuilder::Config config;
+    config.memory_budget_bytes = 4096 * 2 * sizeof(PostingEntry);
+    config.spill_directory = ".";
+    config.directory = Segment::Directory::EliasFano;
+    IndexBuilder builder(config);
+    for (const auto& entry : entries) {
+        builder.add(entry.hash, entry.content, entry.position);
+    }
+    assert(builder.numRuns() > 1);
+    assert(builder.buildFile(path));
+    auto external = Segment::open(path);
+    assert(external && external->sizeBytes() == compact->sizeBytes());
+    assert(std::equal(external->data(), external->data() + external->sizeBytes(), compact->data()));
+
+    std::filesystem::remove(path);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testBloomFilter() {
+    std::cout << "Test: Bloom Filter... ";
+
+    std::mt19937 rng(17);
+    std::vector<uint32_t> keys;
+    for (int i = 0; i < 20000; ++i) {
+        keys.push_back(static_cast<uint32_t>(rng()));
+    }
+
+    for (double fpr : {0.1, 0.01, 0.001}) {
+        BloomFilter filter(keys.size(), fpr);
+        for (uint32_t key : keys) {
+            filter.add(key);
+        }
+
+        // Never a false negative
+        for (uint32_t key : keys) {
+            assert(filter.mayContain(key));
+        }
+
+        // Sequential probes: as structured as real sub-fingerprints
+        size_t false_positives = 0;
+        const size_t probes = 200000;
+        for (uint32_t probe = 0; probe < probes; ++probe) {
+            if (filter.mayContain(0x80000000u + probe)) {
+                ++false_positives;
+            }
+        }
+        assert(static_cast<double>(false_positives) / probes < 2 * fpr);
+
+        // The encoding round-trips through an attached view
+        std::vector<uint64_t> words = filter.encode();
+        assert(words.size() == BloomFilter::HEADER_WORDS +
+                               filter.sizeBytes() / sizeof(uint64_t));
+        BloomFilter view;
+        assert(view.attach(words.data(), words.size()));
+        for (uint32_t key : keys) {
+            assert(view.mayContain(key));
+        }
+        assert(view.encode().empty());
+        assert(!view.attach(words.data(), words.size() - 1));
+    }
+
+    assert(BloomFilter().mayContain(42));
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testSegmentFilter() {
+    std::cout << "Test: Segment Key Filter... ";
+
+    std::vector<PostingEntry> entries;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        entries.push_back({i * 7, i, 0});
+    }
+
+    for (auto directory : {Segment::Directory::Sorted, Segment::Directory::EliasFano}) {
+        auto segment = Segment::build(entries, directory, 0.01);
+        assert(segment->filterBytes() > 0);
+        assert(Segment::build(entries, directory)->filterBytes() == 0);
+
+        size_t rejected = 0;
+        for (uint32_t i = 0; i < 5000; ++i) {
+            assert(segment->lookup(i * 7).size() == 1);
+            assert(segment->lookup(i * 7 + 3).empty());
+            rejected += segment->mayContain(i * 7 + 3) ? 0 : 1;
+        }
+        assert(rejected > 4800);
+
+        // Filters survive files and merges
+        std::string path = "test_filter.seg";
+        assert(segment->writeTo(path));
+        auto reopened = Segment::open(path);
+        assert(reopened && reopened->filterBytes() == segment->filterBytes());
+        assert(!reopened->mayContain(3) || !reopened->mayContain(10));
+        assert(reopened->lookup(70).size() == 1);
+        std::filesystem::remove(path);
+
+        auto merged = Segment::merge({segment, Segment::build({{3, 9, 9}})}, directory, 0.01);
+        assert(merged->mayContain(3) && merged->lookup(3).size() == 1);
+    }
+
+    std::cout << "PASSED" << std::endl;
+}
+
+void testSharedMemorySegment() {
+    std::cout << "Test: Shared-Memory Segment... ";
+
+    std::vector<PostingEntry> entries;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        entries.push_back({i * 3, i, i % 7});
+    }
+    auto segment = Segment::build(entries, Segment::Directory::EliasFano, 0.01);
+
+    std::string name = "/vfs-test-" + std::to_string(getpid());
+    Segment::unlinkShared(name);
+    assert(segment->publishShared(name));
+    assert(!segment->publishShared(name));   // Names are never overwritten
+
+    // Another process attaches to the same object read-only
+    pid_t child = fork();
+    if (child == 0) {
+        auto attached = Segment::openShared(name);
+        bool ok = attached && attached->numPostings() == 1000 &&
+                  attached->lookup(300).size() == 1 &&
+                  attached->lookup(300).begin()->content == 100 &&
+                  attached->lookup(301).empty();
+        _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    assert(waitpid(child, &status, 0) == child);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    auto attached = Segment::openShared(name);
+    assert(attached && attached->data() != segment->data());
+    assert(attached->sizeBytes() == segment->sizeBytes());
+
+    SegmentedIndex::Config config;
+    config.background_merges = false;
+    SegmentedIndex index(config);
+    index.addSegment(attached);
+    std::vector<Posting> postings;
+    index.lookup(27, postings);
+    assert(postings.size() == 1 && postings[0].content == 9);
+
+    // Flushed segments merge around the shared one, which is never copied
+    config.memtable_max_postings = 10;
+    config.tier_base_postings = 1 << 20;
+    config.merge_fanout = 2;
+    SegmentedIndex merging(config);
+    merging.addSegment(attached);
+    for (uint32_t i = 0; i < 40; ++i) {
+        merging.add(i * 3, 5000 + i, 0);
+    }
+    merging.flush();
+    merging.waitForBackgroundWork();
+    assert(merging.getStats().merges > 0);
+    auto merged_segments = merging.segments();
+    assert(std::find(merged_segments->begin(), merged_segments->end(), attached) !=
+           merged_segments->end());
+    postings.clear();
+    merging.lookup(27, postings);
+    assert(postings.size() == 2);
+
+    // Unlinking removes the name but not live mappings
+    assert(Segment::unlinkShared(name));
+    assert(!Segment::openShared(name));
+    assert(attached->lookup(27).size() == 1);
+
+    std::cout << "PASSED" << std::endl;
+}
+
+int main() {
+    std::cout << "=== Posting Index Tests ===" << std::endl;
+    std::cout << std::endl;
+
+    try {
+        testSegmentBuildAndLookup();
+        testSegmentMerge();
+        testMemtableFlushAndMerge();
+        testConcurrentIngestAndLookup();
+        testTieredStore();
+        testParallelRadixSortBuild();
+        testExternalMergeBuild();
+        testEliasFano();
+        testCompactDirectory();
+        testBloomFilter();
+        testSegmentFilter();
+        testSharedMemorySegment();
+
+        std::cout << std::endl;
+        std::cout << "All tests passed!" << std::endl;
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -1,11 +1,20 @@
 #include "matcher/matcher_service.h"
+#include "matcher/stream_matcher.h"
 #include "core/fingerprint_generator.h"
+#include "index/segmented_index.h"
 #include <iostream>
 #include <cassert>
 #include <filesystem>
+#include <thread>
+#include <map>
+#include <cmath>
 
 using namespace vfs;
 
+matcher::ResultCache::Results resultSet(matcher::ResultCache::ResultSet results) {
+    return std::make_shared<const matcher::ResultCache::ResultSet>(std::move(results));
+}
+
 void testBasicMatching() {
     std::cout << "Test: Basic Matching... ";
     
@@ -133,21 +142,1164 @@ void testCaching() {
     core::FingerprintGenerator generator;
     auto fp = generator.generateFromFile("test.wav");
     
+    // Only non-empty results are cached, so give the query something to match
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "cached_content";
+    metadata.title = "Cached Content";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
     matcher::MatcherService::MatchRequest request;
     request.request_id = "cache_001";
     request.fingerprint = fp;
+    request.min_similarity = 0.1;
+    request.max_results = 10;
     
     // First request - cache miss
-    service.match(request);
+    auto first = service.match(request);
     
     // Second request - should be cache hit
-    service.match(request);
+    auto second = service.match(request);
     
     auto stats = service.getStats();
     assert(stats.cache_hits > 0);
     
+    // Hits share the cached result set instead of copying it
+    assert(!second.matches.empty());
+    assert(second.matches.shared() == first.matches.shared());
+    
+    // Queued requests are moved in whole
+    auto moved = service.matchAsync(std::move(request)).get();
+    assert(moved.request_id == "cache_001");
+    assert(moved.matches.shared() == first.matches.shared());
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testCacheEviction() {
+    std::cout << "Test: LRU Cache Eviction... ";
+    
+    std::string test_db = "test_cache_lru.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    
+    matcher::MatcherService::Config config;
+    config.cache_size = 2;
+    config.cache_shards = 1;     // Exact LRU order across all entries
+    
+    matcher::MatcherService service(db, metrics, config);
+    
+    // Three small synthetic fingerprints, each stored so it matches itself
+    std::vector<matcher::MatcherService::MatchRequest> requests;
+    for (uint32_t c = 0; c < 3; ++c) {
+        core::FingerprintGenerator::Fingerprint fp;
+        fp.duration_ms = 1000;
+        for (uint32_t i = 0; i < 50; ++i) {
+            fp.hash_values.push_back((c + 1) * 0x01000193u * (i + 1));
+        }
+        fp.raw_hash = "synthetic_" + std::to_string(c);
+        
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = fp.raw_hash;
+        metadata.title = fp.raw_hash;
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        db->storeFingerprint(metadata.content_id, fp, metadata);
+        
+        matcher::MatcherService::MatchRequest request;
+        request.request_id = fp.raw_hash;
+        request.fingerprint = fp;
+        request.min_similarity = 0.5;
+        request.max_results = 10;
+        requests.push_back(request);
+    }
+    
+    auto hits = [&service]() { return service.getStats().cache_hits; };
+    
+    service.match(requests[0]);
+    service.match(requests[1]);
+    service.match(requests[0]);            // Hit: 0 becomes most recent
+    assert(hits() == 1);
+    
+    service.match(requests[2]);            // Evicts 1, the least recent
+    service.match(requests[0]);
+    assert(hits() == 2);
+    service.match(requests[1]);            // Miss: was evicted
+    assert(hits() == 2);
+    service.match(requests[0]);            // Still cached after 1 evicted 2
+    assert(hits() == 3);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testCacheKeys() {
+    std::cout << "Test: Full-Fingerprint Cache Keys... ";
+    
+    std::string test_db = "test_cache_keys.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    matcher::MatcherService service(db, metrics);
+    
+    // Two queries share an opening far longer than the old 64-char prefix
+    core::FingerprintGenerator::Fingerprint fp_a;
+    fp_a.duration_ms = 1000;
+    for (uint32_t i = 0; i < 64; ++i) {
+        fp_a.hash_values.push_back(0x9E3779B9u * (i + 1));
+    }
+    fp_a.raw_hash = std::string(128, 'a');
+    
+    auto fp_b = fp_a;
+    for (size_t i = 32; i < fp_b.hash_values.size(); ++i) {
+        fp_b.hash_values[i] ^= 0xFFFF0000u;
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "content_a";
+    metadata.title = "Content A";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp_a, metadata);
+    
+    matcher::MatcherService::MatchRequest request;
+    request.request_id = "keys";
+    request.fingerprint = fp_a;
+    request.min_similarity = 0.9;
+    request.max_results = 10;
+    
+    auto first = service.match(request);
+    assert(first.matches.size() == 1);
+    
+    // Same opening, different tail: must not reuse content_a's results
+    request.fingerprint = fp_b;
+    auto second = service.match(request);
+    assert(service.getStats().cache_hits == 0);
+    assert(second.matches.empty());
+    
+    // Same fingerprint, different parameters: a separate entry
+    request.fingerprint = fp_a;
+    request.max_results = 5;
+    service.match(request);
+    assert(service.getStats().cache_hits == 0);
+    
+    request.max_results = 10;
+    service.match(request);
+    assert(service.getStats().cache_hits == 1);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testNearDuplicateCache() {
+    std::cout << "Test: Near-Duplicate Cache Hits... ";
+    
+    std::string test_db = "test_cache_near.db";
     std::filesystem::remove(test_db);
     
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    
+    matcher::MatcherService::Config config;
+    config.near_duplicate_similarity = 0.9;
+    
+    matcher::MatcherService service(db, metrics, config);
+    
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 5000;
+    for (uint32_t i = 0; i < 200; ++i) {
+        fp.hash_values.push_back(0x85EBCA6Bu * (i + 7) ^ (i << 13));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "broadcast_clip";
+    metadata.title = "Broadcast Clip";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
+    matcher::MatcherService::MatchRequest request;
+    request.request_id = "near";
+    request.fingerprint = fp;
+    request.min_similarity = 0.5;
+    request.max_results = 10;
+    
+    auto original = service.match(request);
+    assert(original.matches.size() == 1);
+    
+    // A re-detection: two frames late, with a few flipped bits
+    auto noisy = fp;
+    noisy.hash_values.erase(noisy.hash_values.begin(), noisy.hash_values.begin() + 2);
+    for (size_t i = 0; i < noisy.hash_values.size(); i += 40) {
+        noisy.hash_values[i] ^= 0x00010001u;
+    }
+    request.fingerprint = noisy;
+    
+    auto near = service.match(request);
+    auto stats = service.getStats();
+    assert(stats.cache_near_hits == 1);
+    assert(stats.cache_hits == 1);
+    assert(near.matches.size() == 1);
+    assert(near.matches[0].metadata.content_id == "broadcast_clip");
+    
+    // Unrelated content never verifies
+    core::FingerprintGenerator::Fingerprint other;
+    for (uint32_t i = 0; i < 200; ++i) {
+        other.hash_values.push_back(0xCC9E2D51u * (i + 1));
+    }
+    request.fingerprint = other;
+    service.match(request);
+    assert(service.getStats().cache_near_hits == 1);
+    
+    // Different parameters never share entries
+    request.fingerprint = noisy;
+    request.max_results = 3;
+    service.match(request);
+    assert(service.getStats().cache_near_hits == 1);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testCacheInvalidation() {
+    std::cout << "Test: Cache Invalidation on Ingest... ";
+    
+    std::string test_db = "test_cache_ingest.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    matcher::MatcherService service(db, metrics);
+    
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 1000;
+    for (uint32_t i = 0; i < 50; ++i) {
+        fp.hash_values.push_back(0x27D4EB2Fu * (i + 3));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "original";
+    metadata.title = "Original";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    
+    uint64_t generation = db->getGeneration();
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    assert(db->getGeneration() > generation);
+    
+    matcher::MatcherService::MatchRequest request;
+    request.request_id = "ingest";
+    request.fingerprint = fp;
+    request.min_similarity = 0.5;
+    request.max_results = 10;
+    
+    assert(service.match(request).matches.size() == 1);
+    assert(service.match(request).matches.size() == 1);
+    assert(service.getStats().cache_hits == 1);
+    assert(service.getStats().cache_bytes > 0);
+    
+    // A re-upload of the same content must show up immediately
+    metadata.content_id = "reupload";
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
+    auto response = service.match(request);
+    assert(service.getStats().cache_hits == 1);
+    assert(response.matches.size() == 2);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testCacheBudgets() {
+    std::cout << "Test: Cache Byte Budget and TTL... ";
+    
+    database::DatabaseManager::MatchResult result;
+    result.metadata.content_id = "content";
+    result.metadata.title = std::string(1000, 't');
+    result.similarity_score = 0.9;
+    result.matched_segments = 3;
+    
+    matcher::ResultCache::Config config;
+    config.capacity = 1000;
+    config.num_shards = 1;
+    config.max_bytes = 8 * 1024;
+    
+    matcher::ResultCache cache(config);
+    
+    // Each entry holds about 1 KB of strings: the byte budget binds first
+    for (matcher::ResultCache::Key key = 0; key < 50; ++key) {
+        cache.insert(key, resultSet({result}));
+        assert(cache.sizeBytes() <= config.max_bytes);
+    }
+    assert(cache.size() < 10);
+    assert(cache.getShardStats()[0].evictions > 0);
+    assert(cache.lookup(49));
+    assert(!cache.lookup(0));
+    
+    // An entry larger than the whole budget is not cached at all
+    result.metadata.title = std::string(16 * 1024, 't');
+    cache.insert(100, resultSet({result}));
+    assert(!cache.lookup(100));
+    assert(cache.lookup(49));
+    
+    // Entries from an older generation are dropped on lookup
+    cache.insert(200, resultSet({}), 5);
+    assert(cache.lookup(200, 5));
+    assert(!cache.lookup(200, 6));
+    
+    // Entries past the TTL expire
+    config.max_bytes = 0;
+    config.ttl = std::chrono::milliseconds(20);
+    matcher::ResultCache ttl_cache(config);
+    ttl_cache.insert(1, resultSet({}));
+    assert(ttl_cache.lookup(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    assert(!ttl_cache.lookup(1));
+    assert(ttl_cache.getShardStats()[0].expirations == 1);
+    assert(ttl_cache.size() == 0);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testShardedCache() {
+    std::cout << "Test: Sharded Result Cache... ";
+    
+    auto cacheConfig = [](size_t capacity, size_t shards) {
+        matcher::ResultCache::Config config;
+        config.capacity = capacity;
+        config.num_shards = shards;
+        return config;
+    };
+    
+    matcher::ResultCache cache(cacheConfig(64, 8));
+    assert(cache.numShards() == 8);
+    
+    // Shard count never exceeds capacity and is a power of two
+    assert(matcher::ResultCache(cacheConfig(3, 16)).numShards() == 2);
+    assert(matcher::ResultCache(cacheConfig(100, 12)).numShards() == 8);
+    
+    database::DatabaseManager::MatchResult result;
+    result.metadata.content_id = "content";
+    result.similarity_score = 0.9;
+    result.matched_segments = 3;
+    
+    // Hammer the cache from several threads
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&cache, &result, t]() {
+            for (int i = 0; i < 2000; ++i) {
+                matcher::ResultCache::Key key = (i * 31 + t) % 200;
+                if (!cache.lookup(key)) {
+                    cache.insert(key, resultSet({result}));
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    auto stats = cache.getShardStats();
+    assert(stats.size() == 8);
+    
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    size_t entries = 0;
+    for (const auto& shard : stats) {
+        assert(shard.entries <= 8);
+        hits += shard.hits;
+        misses += shard.misses;
+        evictions += shard.evictions;
+        entries += shard.entries;
+    }
+    assert(hits + misses == 4 * 2000);
+    assert(evictions > 0);
+    assert(entries == cache.size());
+    assert(entries <= 64);
+    
+    cache.insert(1000, resultSet({result}));
+    auto cached = cache.lookup(1000);
+    assert(cached && cached->size() == 1);
+    assert((*cached)[0].metadata.content_id == "content");
+    
+    cache.clear();
+    assert(cache.size() == 0);
+    assert(!cache.lookup(1000));
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testRequestCoalescing() {
+    std::cout << "Test: Request Coalescing... ";
+    
+    std::string test_db = "test_coalesce.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    
+    matcher::MatcherService::Config config;
+    config.num_threads = 8;
+    config.enable_caching = false;    // Duplicates can only share in-flight work
+    
+    matcher::MatcherService service(db, metrics, config);
+    
+    // A long query keeps the leader busy while the duplicates arrive
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 600000;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        fp.hash_values.push_back(0x165667B1u * (i + 1));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "popular_clip";
+    metadata.title = "Popular Clip";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
+    std::vector<std::future<matcher::MatcherService::MatchResponse>> futures;
+    for (int i = 0; i < 16; ++i) {
+        matcher::MatcherService::MatchRequest request;
+        request.request_id = "popular_" + std::to_string(i);
+        request.fingerprint = fp;
+        request.min_similarity = 0.5;
+        request.max_results = 10;
+        futures.push_back(service.matchAsync(request));
+    }
+    
+    for (auto& future : futures) {
+        auto response = future.get();
+        assert(response.success);
+        assert(response.matches.size() == 1);
+        assert(response.matches[0].metadata.content_id == "popular_clip");
+    }
+    
+    auto stats = service.getStats();
+    assert(stats.coalesced_requests > 0);
+    assert(stats.successful_matches == 16);
+    assert(metrics->getCounter("match_coalesced_hits") == stats.coalesced_requests);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testRequestDeadlines() {
+    std::cout << "Test: Request Deadlines... ";
+    
+    std::string test_db = "test_deadlines.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    matcher::MatcherService service(db, metrics);
+    
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 1000;
+    for (uint32_t i = 0; i < 100; ++i) {
+        fp.hash_values.push_back(0x3C6EF372u * (i + 1));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "timely";
+    metadata.title = "Timely";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
+    // Already expired when dequeued: dropped without touching the DB
+    matcher::MatcherService::MatchRequest request;
+    request.request_id = "late";
+    request.fingerprint = fp;
+    request.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    
+    auto dropped = service.matchAsync(request).get();
+    assert(!dropped.success);
+    assert(dropped.matches.empty());
+    assert(service.getStats().expired_requests == 1);
+    assert(service.getStats().cache_misses == 0);
+    
+    // A generous budget completes in full, and the result is cached
+    request.request_id = "timely";
+    request.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    
+    auto response = service.match(request);
+    assert(response.success);
+    assert(!response.partial);
+    assert(response.matches.size() == 1);
+    
+    service.match(request);
+    assert(service.getStats().cache_hits == 1);
+    assert(service.getStats().partial_matches == 0);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testAdmissionControl() {
+    std::cout << "Test: Admission Control... ";
+    
+    std::string test_db = "test_admission.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    
+    // Long queries keep the single worker busy while the queue fills
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 600000;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        fp.hash_values.push_back(0x7FEB352Du * (i + 1));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "overload";
+    metadata.title = "Overload";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
+    auto makeRequests = [&fp](size_t count) {
+        std::vector<matcher::MatcherService::MatchRequest> requests;
+        for (size_t i = 0; i < count; ++i) {
+            matcher::MatcherService::MatchRequest request;
+            request.request_id = "overload_" + std::to_string(i);
+            request.fingerprint = fp;
+            request.min_similarity = 0.5;
+            requests.push_back(request);
+        }
+        return requests;
+    };
+    
+    matcher::MatcherService::Config config;
+    config.num_threads = 1;
+    config.enable_caching = false;
+    config.enable_coalescing = false;
+    config.max_queued_requests = 2;
+    
+    {
+        // Reject: at most one running and two queued are admitted at once
+        matcher::MatcherService service(db, metrics, config);
+        
+        std::vector<std::future<matcher::MatcherService::MatchResponse>> futures;
+        for (const auto& request : makeRequests(12)) {
+            futures.push_back(service.matchAsync(request));
+            assert(service.getStats().queue_depth <= 2);
+        }
+        
+        size_t rejected = 0;
+        for (auto& future : futures) {
+            auto response = future.get();
+            if (!response.success) {
+                assert(response.error_message.find("queue") != std::string::npos);
+                ++rejected;
+            }
+        }
+        
+        auto stats = service.getStats();
+        assert(rejected > 0);
+        assert(stats.rejected_requests == rejected);
+        assert(stats.total_requests + rejected == 12);
+        assert(stats.queue_depth == 0);
+    }
+    
+    {
+        // Block: everyone gets in once the worker drains the queue
+        config.admission_policy = matcher::MatcherService::AdmissionPolicy::Block;
+        config.admission_timeout_ms = 60000;
+        matcher::MatcherService service(db, metrics, config);
+        
+        std::vector<std::future<matcher::MatcherService::MatchResponse>> futures;
+        for (const auto& request : makeRequests(4)) {
+            futures.push_back(service.matchAsync(request));
+        }
+        for (auto& future : futures) {
+            assert(future.get().success);
+        }
+        
+        // Batches are admitted slot by slot, never rejected
+        for (const auto& response : service.matchBatch(makeRequests(4))) {
+            assert(response.success);
+        }
+        assert(service.getStats().rejected_requests == 0);
+    }
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testPriorityScheduling() {
+    std::cout << "Test: Priority Scheduling... ";
+    
+    std::string test_db = "test_priority.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 600000;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        fp.hash_values.push_back(0x61C88647u * (i + 1));
+    }
+    
+    database::DatabaseManager::ContentMetadata metadata;
+    metadata.content_id = "catalog";
+    metadata.title = "Catalog";
+    metadata.source = "test";
+    metadata.created_at = 1234567890;
+    db->storeFingerprint(metadata.content_id, fp, metadata);
+    
+    auto request = [&fp](const std::string& id, matcher::MatcherService::Priority priority) {
+        matcher::MatcherService::MatchRequest req;
+        req.request_id = id;
+        req.fingerprint = fp;
+        req.min_similarity = 0.5;
+        req.priority = priority;
+        return req;
+    };
+    
+    auto isReady = [](std::future<matcher::MatcherService::MatchResponse>& future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    
+    matcher::MatcherService::Config config;
+    config.num_threads = 1;
+    config.enable_caching = false;
+    config.enable_coalescing = false;
+    config.priority_aging_ms = 60000;
+    
+    {
+        // A live request overtakes the queued batch
+        matcher::MatcherService service(db, metrics, config);
+        
+        std::vector<std::future<matcher::MatcherService::MatchResponse>> batch;
+        for (int i = 0; i < 5; ++i) {
+            batch.push_back(service.matchAsync(
+                request("batch_" + std::to_string(i), matcher::MatcherService::Priority::Batch)));
+        }
+        auto live = service.matchAsync(request("live", matcher::MatcherService::Priority::Live));
+        
+        assert(live.get().success);
+        size_t batch_done = 0;
+        for (auto& future : batch) {
+            batch_done += isReady(future) ? 1 : 0;
+        }
+        assert(batch_done <= 1);    // Only the one already running
+        
+        for (auto& future : batch) {
+            assert(future.get().success);
+        }
+    }
+    
+    {
+        // Past the aging limit, waiting requests run oldest first
+        config.priority_aging_ms = 0;
+        matcher::MatcherService service(db, metrics, config);
+        
+        std::vector<std::future<matcher::MatcherService::MatchResponse>> batch;
+        for (int i = 0; i < 3; ++i) {
+            batch.push_back(service.matchAsync(
+                request("aged_" + std::to_string(i), matcher::MatcherService::Priority::Batch)));
+        }
+        auto live = service.matchAsync(request("live", matcher::MatcherService::Priority::Live));
+        
+        assert(live.get().success);
+        for (auto& future : batch) {
+            assert(isReady(future));
+        }
+    }
+    
+    assert(metrics->getLatencyStats("match_queue_wait_live").count == 2);
+    assert(metrics->getLatencyStats("match_queue_wait_batch").count == 8);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testParallelQuery() {
+    std::cout << "Test: Parallel Long Query... ";
+    
+    std::string test_db = "test_parallel_query.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    // A long clip, and two stored items sharing parts of it
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 600000;
+    for (uint32_t i = 0; i < 6000; ++i) {
+        fp.hash_values.push_back(0x7F4A7C15u * (i + 1) ^ (i >> 3));
+    }
+    
+    auto store = [&](const std::string& id, size_t begin, size_t end) {
+        core::FingerprintGenerator::Fingerprint part;
+        part.duration_ms = fp.duration_ms;
+        part.hash_values.assign(fp.hash_values.begin() + begin, fp.hash_values.begin() + end);
+        
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = id;
+        metadata.title = id;
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db->storeFingerprint(id, part, metadata));
+    };
+    store("full", 0, 6000);
+    store("tail", 2500, 6000);
+    
+    assert(db->attachIndex(std::make_shared<index::SegmentedIndex>()));
+    auto expected = db->findMatches(fp, 0.0, 10);
+    assert(expected.size() == 2);
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    matcher::MatcherService::Config config;
+    config.num_threads = 4;
+    config.enable_caching = false;
+    config.enable_coalescing = false;
+    config.parallel_query_threshold = 1024;
+    config.parallel_query_chunk = 500;
+    matcher::MatcherService service(db, metrics, config);
+    
+    matcher::MatcherService::MatchRequest request;
+    request.request_id = "long";
+    request.fingerprint = fp;
+    request.min_similarity = 0.01;
+    
+    // Chunked votes merge to the same ranking as one sequential pass
+    auto response = service.match(request);
+    assert(response.success);
+    assert(!response.partial);
+    assert(response.matches.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        assert(response.matches[i].metadata.content_id == expected[i].metadata.content_id);
+        assert(response.matches[i].similarity_score == expected[i].similarity_score);
+        assert(response.matches[i].matched_segments == expected[i].matched_segments);
+    }
+    assert(metrics->getCounter("match_parallel_queries") == 1);
+    
+    // Several long queries at once: callers vote on their own chunks too
+    std::vector<std::future<matcher::MatcherService::MatchResponse>> futures;
+    for (int i = 0; i < 8; ++i) {
+        futures.push_back(service.matchAsync(request));
+    }
+    for (auto& future : futures) {
+        auto concurrent = future.get();
+        assert(concurrent.success);
+        assert(concurrent.matches.size() == expected.size());
+    }
+    
+    // Short queries stay on the calling thread
+    request.fingerprint.hash_values.resize(500);
+    assert(service.match(request).success);
+    assert(metrics->getCounter("match_parallel_queries") == 9);
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testSharedBatch() {
+    std::cout << "Test: Shared-Lookup Batch... ";
+    
+    std::string test_db = "test_shared_batch.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    
+    core::FingerprintGenerator::Fingerprint fp;
+    fp.duration_ms = 60000;
+    for (uint32_t i = 0; i < 2000; ++i) {
+        fp.hash_values.push_back(0x5851F42Du * (i + 1) ^ (i >> 2));
+    }
+    
+    auto window = [&](size_t begin, size_t end) {
+        core::FingerprintGenerator::Fingerprint part;
+        part.duration_ms = fp.duration_ms;
+        part.hash_values.assign(fp.hash_values.begin() + begin, fp.hash_values.begin() + end);
+        return part;
+    };
+    
+    auto store = [&](const std::string& id, size_t begin, size_t end) {
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = id;
+        metadata.title = id;
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db->storeFingerprint(id, window(begin, end), metadata));
+    };
+    store("whole", 0, 2000);
+    store("front", 0, 1200);
+    store("back", 800, 2000);
+    
+    assert(db->attachIndex(std::make_shared<index::SegmentedIndex>()));
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    matcher::MatcherService service(db, metrics);
+    
+    // Overlapping windows of one recording, plus an exact repeat
+    std::vector<matcher::MatcherService::MatchRequest> requests;
+    for (size_t begin = 0; begin + 600 <= 2000; begin += 200) {
+        matcher::MatcherService::MatchRequest request;
+        request.request_id = "window_" + std::to_string(begin);
+        request.fingerprint = window(begin, begin + 600);
+        request.min_similarity = 0.1;
+        requests.push_back(request);
+    }
+    requests.push_back(requests.front());
+    requests.back().request_id = "repeat";
+    
+    // One pass over the shared hashes answers each query as if run alone
+    auto responses = service.matchBatch(requests);
+    assert(responses.size() == requests.size());
+    for (size_t i = 0; i < requests.size(); ++i) {
+        assert(responses[i].success);
+        assert(responses[i].request_id == requests[i].request_id);
+        
+        auto expected = db->findMatches(requests[i].fingerprint, 0.1, 10);
+        assert(!expected.empty());
+        assert(responses[i].matches.size() == expected.size());
+        for (size_t m = 0; m < expected.size(); ++m) {
+            assert(responses[i].matches[m].metadata.content_id == expected[m].metadata.content_id);
+            assert(responses[i].matches[m].similarity_score == expected[m].similarity_score);
+            assert(responses[i].matches[m].matched_segments == expected[m].matched_segments);
+        }
+    }
+    assert(metrics->getCounter("match_shared_batches") == 1);
+    
+    // The batch was scheduled as one Batch-class task holding one queue slot
+    assert(metrics->getLatencyStats("match_queue_wait_batch").count == 1);
+    assert(service.getStats().queue_depth == 0);
+    
+    auto stats = service.getStats();
+    assert(stats.total_requests == requests.size());
+    assert(stats.successful_matches == requests.size());
+    assert(stats.coalesced_requests == 1);
+    
+    // Answers were cached like single matches, and hits are counted alike
+    service.matchBatch(requests);
+    stats = service.getStats();
+    assert(stats.cache_hits == requests.size());
+    assert(stats.successful_matches == requests.size());
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testStreamMatcher() {
+    std::cout << "Test: Stream Matcher... ";
+    
+    std::string test_db = "test_stream.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    assert(db->attachIndex(std::make_shared<index::SegmentedIndex>()));
+    
+    auto make = [](uint32_t seed, size_t count) {
+        std::vector<uint32_t> hashes;
+        for (uint32_t i = 0; i < count; ++i) {
+            hashes.push_back(seed * (i + 1) ^ (i >> 1));
+        }
+        return hashes;
+    };
+    
+    auto store = [&](const std::string& id, const std::vector<uint32_t>& hashes) {
+        core::FingerprintGenerator::Fingerprint fp;
+        fp.duration_ms = 10000;
+        fp.hash_values = hashes;
+        
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = id;
+        metadata.title = id;
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db->storeFingerprint(id, fp, metadata));
+    };
+    
+    auto song = make(0x9E3779B1u, 500);
+    auto ad = make(0x85EBCA77u, 300);
+    store("song", song);
+    store("ad", ad);
+    
+    // Noise, the middle of the song, noise, the whole ad, noise
+    std::vector<uint32_t> stream = make(0xC2B2AE3Du, 200);
+    stream.insert(stream.end(), song.begin() + 50, song.begin() + 450);
+    auto noise = make(0x27D4EB2Fu, 1200);
+    stream.insert(stream.end(), noise.begin(), noise.begin() + 600);
+    stream.insert(stream.end(), ad.begin(), ad.end());
+    stream.insert(stream.end(), noise.begin() + 600, noise.end());
+    
+    matcher::StreamMatcher::Config config;
+    config.window_hashes = 128;
+    matcher::StreamMatcher session(db, config);
+    
+    std::vector<matcher::StreamMatcher::MatchEvent> events;
+    for (size_t i = 0; i < stream.size(); i += 50) {
+        std::vector<uint32_t> chunk(stream.begin() + i,
+                                    stream.begin() + std::min(i + 50, stream.size()));
+        auto produced = session.push(chunk);
+        events.insert(events.end(), produced.begin(), produced.end());
+        
+        // Mid-song, the session knows where in the song the stream is
+        if (session.position() == 400) {
+            auto active = session.activeMatches();
+            assert(active.size() == 1);
+            assert(active[0].content_id == "song");
+            assert(active[0].offset == 50 - 200);
+        }
+    }
+    assert(session.position() == stream.size());
+    assert(session.finish().empty());
+    
+    using Type = matcher::StreamMatcher::EventType;
+    assert(events.size() == 4);
+    assert(events[0].type == Type::Start && events[0].content_id == "song");
+    assert(events[1].type == Type::End && events[1].content_id == "song");
+    assert(events[2].type == Type::Start && events[2].content_id == "ad");
+    assert(events[3].type == Type::End && events[3].content_id == "ad");
+    
+    // Reported within a push of where the content starts and stops
+    assert(events[0].stream_position > 200 && events[0].stream_position <= 250);
+    assert(events[0].content_position == static_cast<int64_t>(events[0].stream_position) - 150);
+    assert(events[1].stream_position > 600 && events[1].stream_position <= 600 + 128 + 50);
+    assert(events[2].stream_position > 1200 && events[2].stream_position <= 1250);
+    assert(events[3].stream_position > 1500 && events[3].stream_position <= 1500 + 128 + 50);
+    
+    // A stream cut mid-match is closed by finish
+    matcher::StreamMatcher cut(db, config);
+    assert(cut.push(std::vector<uint32_t>(song.begin(), song.begin() + 100)).size() == 1);
+    auto closed = cut.finish();
+    assert(closed.size() == 1);
+    assert(closed[0].type == Type::End && closed[0].content_id == "song");
+    assert(cut.activeMatches().empty());
+    
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testStreamMonitor() {
+    std::cout << "Test: Multi-Channel Stream Monitor... ";
+    
+    std::string test_db = "test_stream_monitor.db";
+    std::filesystem::remove(test_db);
+    
+    auto db = std::make_shared<database::DatabaseManager>(test_db);
+    db->initialize();
+    assert(db->attachIndex(std::make_shared<index::SegmentedIndex>()));
+    
+    auto make = [](uint32_t seed, size_t count) {
+        std::vector<uint32_t> hashes;
+        for (uint32_t i = 0; i < count; ++i) {
+            hashes.push_back(seed * (i + 1) ^ (i >> 1));
+        }
+        return hashes;
+    };
+    
+    const uint32_t seeds[] = {0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du};
+    std::vector<std::vector<uint32_t>> items;
+    for (int i = 0; i < 3; ++i) {
+        items.push_back(make(seeds[i], 400));
+        
+        core::FingerprintGenerator::Fingerprint fp;
+        fp.duration_ms = 10000;
+        fp.hash_values = items.back();
+        
+        database::DatabaseManager::ContentMetadata metadata;
+        metadata.content_id = "item_" + std::to_string(i);
+        metadata.title = metadata.content_id;
+        metadata.source = "test";
+        metadata.created_at = 1234567890;
+        assert(db->storeFingerprint(metadata.content_id, fp, metadata));
+    }
+    
+    auto metrics = std::make_shared<monitoring::MetricsCollector>();
+    matcher::MatcherService service(db, metrics);
+    
+    std::mutex events_mutex;
+    std::map<std::string, std::vector<matcher::StreamMatcher::MatchEvent>> events;
+    
+    matcher::StreamMonitor::Config config;
+    config.num_workers = 2;
+    config.tick_ms = 5;
+    config.session.window_hashes = 128;
+    auto monitor = service.createStreamMonitor(
+        [&](const std::string& channel, const matcher::StreamMatcher::MatchEvent& event) {
+            std::lock_guard<std::mutex> lock(events_mutex);
+            events[channel].push_back(event);
+        }, config);
+    
+    // Six channels, two per item, spread evenly over the workers
+    const size_t num_channels = 6;
+    for (size_t c = 0; c < num_channels; ++c) {
+        assert(monitor->addChannel("channel_" + std::to_string(c)));
+    }
+    assert(!monitor->addChannel("channel_0"));
+    assert(monitor->numChannels() == num_channels);
+    
+    std::vector<std::vector<uint32_t>> streams;
+    for (size_t c = 0; c < num_channels; ++c) {
+        auto stream = make(0x27D4EB2Fu + static_cast<uint32_t>(c), 100);
+        const auto& item = items[c % 3];
+        stream.insert(stream.end(), item.begin(), item.end());
+        streams.push_back(stream);
+    }
+    
+    // Fed concurrently in small chunks, as live capture would be
+    std::vector<std::thread> feeders;
+    for (size_t c = 0; c < num_channels; ++c) {
+        feeders.emplace_back([&, c]() {
+            for (size_t i = 0; i < streams[c].size(); i += 25) {
+                std::vector<uint32_t> chunk(streams[c].begin() + i,
+                                            streams[c].begin() + std::min(i + 25, streams[c].size()));
+                assert(monitor->feed("channel_" + std::to_string(c), std::move(chunk)));
+            }
+        });
+    }
+    for (auto& feeder : feeders) {
+        feeder.join();
+    }
+    monitor->flush();
+    
+    auto stats = monitor->getChannelStats();
+    assert(stats.size() == num_channels);
+    size_t on_first_worker = 0;
+    for (const auto& channel : stats) {
+        assert(channel.position == 500);
+        assert(channel.pending_hashes == 0);
+        on_first_worker += channel.worker == 0 ? 1 : 0;
+    }
+    assert(on_first_worker == num_channels / 2);
+    
+    {
+        std::lock_guard<std::mutex> lock(events_mutex);
+        for (size_t c = 0; c < num_channels; ++c) {
+            const auto& channel_events = events["channel_" + std::to_string(c)];
+            assert(channel_events.size() == 1);
+            assert(channel_events[0].type == matcher::StreamMatcher::EventType::Start);
+            assert(channel_events[0].content_id == "item_" + std::to_string(c % 3));
+        }
+    }
+    assert(metrics->getCounter("stream_ticks") > 0);
+    
+    // Removing a channel ends its match; it then takes no more input
+    assert(monitor->removeChannel("channel_0"));
+    assert(!monitor->removeChannel("channel_0"));
+    assert(!monitor->feed("channel_0", {1, 2, 3}));
+    {
+        std::lock_guard<std::mutex> lock(events_mutex);
+        assert(events["channel_0"].size() == 2);
+        assert(events["channel_0"][1].type == matcher::StreamMatcher::EventType::End);
+    }
+    assert(monitor->numChannels() == num_channels - 1);
+    
+    // Adding and removing one name concurrently never orphans either side
+    std::vector<std::thread> churners;
+    for (int t = 0; t < 4; ++t) {
+        churners.emplace_back([&monitor]() {
+            for (int i = 0; i < 200; ++i) {
+                monitor->addChannel("churn");
+                monitor->feed("churn", {1, 2, 3});
+                monitor->removeChannel("churn");
+            }
+        });
+    }
+    for (auto& churner : churners) {
+        churner.join();
+    }
+    monitor->removeChannel("churn");
+    monitor->flush();
+    assert(monitor->numChannels() == num_channels - 1);
+    assert(monitor->getChannelStats().size() == num_channels - 1);
+    
+    monitor.reset();
+    std::filesystem::remove(test_db);
+    
+    std::cout << "PASSED" << std::endl;
+}
+
+void testLatencyHistogram() {
+    std::cout << "Test: Latency Histogram... ";
+    
+    using Histogram = monitoring::LatencyHistogram;
+    
+    // Buckets tile the range, each within ~3% of its values
+    for (uint64_t value : {0ull, 1ull, 31ull, 32ull, 33ull, 1000ull, 123456ull, 1ull << 40}) {
+        size_t bucket = Histogram::bucketFor(value);
+        assert(Histogram::bucketLow(bucket) <= value);
+        assert(value <= Histogram::bucketHigh(bucket));
+        assert(Histogram::bucketHigh(bucket) - Histogram::bucketLow(bucket) <= value / 32);
+    }
+    for (size_t b = 0; b + 1 < Histogram::NUM_BUCKETS; ++b) {
+        assert(Histogram::bucketHigh(b) + 1 == Histogram::bucketLow(b + 1));
+    }
+    assert(Histogram::bucketFor(UINT64_MAX) == Histogram::NUM_BUCKETS - 1);
+    
+    // Recorded from several threads at once, nothing is lost
+    Histogram histogram;
+    std::vector<std::thread> recorders;
+    for (int t = 0; t < 8; ++t) {
+        recorders.emplace_back([&histogram]() {
+            for (uint64_t v = 1; v <= 10000; ++v) {
+                histogram.record(v);
+            }
+        });
+    }
+    for (auto& recorder : recorders) {
+        recorder.join();
+    }
+    
+    auto snapshot = histogram.snapshot();
+    assert(snapshot.count == 80000);
+    assert(snapshot.min == 1);
+    assert(snapshot.max == 10000);
+    assert(snapshot.mean() == 5000.5);
+    
+    // Percentiles within the bucket resolution of the exact values
+    auto near = [](double actual, double expected) {
+        return std::abs(actual - expected) <= expected * 0.04;
+    };
+    assert(near(snapshot.percentile(0.5), 5000));
+    assert(near(snapshot.percentile(0.95), 9500));
+    assert(near(snapshot.percentile(0.99), 9900));
+    assert(snapshot.percentile(1.0) == 10000);
+    
+    histogram.reset();
+    assert(histogram.snapshot().count == 0);
+    assert(histogram.snapshot().percentile(0.99) == 0.0);
+    
     std::cout << "PASSED" << std::endl;
 }
 
@@ -177,6 +1329,7 @@ void testServiceStats() {
     auto stats = service.getStats();
     assert(stats.total_requests == 5);
     assert(stats.avg_latency_us > 0);
+    assert(stats.p99_latency_us >= stats.p95_latency_us);
     
     std::filesystem::remove(test_db);
     
@@ -192,6 +1345,21 @@ int main() {
         testAsyncMatching();
         testBatchMatching();
         testCaching();
+        testCacheEviction();
+        testCacheKeys();
+        testNearDuplicateCache();
+        testCacheInvalidation();
+        testCacheBudgets();
+        testShardedCache();
+        testRequestCoalescing();
+        testRequestDeadlines();
+        testAdmissionControl();
+        testPriorityScheduling();
+        testParallelQuery();
+        testSharedBatch();
+        testStreamMatcher();
+        testStreamMonitor();
+        testLatencyHistogram();
         testServiceStats();
         
         std::cout << std::endl;